@@ -4,6 +4,7 @@
  */
 
 #include <stddef.h>
+#include <string.h>
 #include "SCS.h"
 
 SCS::SCS()
@@ -56,34 +57,36 @@ u16 SCS::SCS2Host(u8 DataL, u8 DataH)
 	return Data;
 }
 
+// Assemble an instruction frame in TxFrame and write it in one call
 void SCS::writeBuf(u8 ID, u8 MemAddr, u8 *nDat, u8 nLen, u8 Fun)
 {
 	u8 msgLen = 2;
-	u8 bBuf[6];
-	u8 CheckSum = 0;
-	bBuf[0] = 0xff;
-	bBuf[1] = 0xff;
-	bBuf[2] = ID;
-	bBuf[4] = Fun;
+	TxFrame[0] = 0xff;
+	TxFrame[1] = 0xff;
+	TxFrame[2] = ID;
+	TxFrame[4] = Fun;
 	if(nDat){
+		if(nLen>SCS_MAX_FRAME-7){
+			return;
+		}
 		msgLen += nLen + 1;
-		bBuf[3] = msgLen;
-		bBuf[5] = MemAddr;
-		writeSCS(bBuf, 6);
-		
-	}else{
-		bBuf[3] = msgLen;
-		writeSCS(bBuf, 5);
+		TxFrame[5] = MemAddr;
+		memcpy(TxFrame+6, nDat, nLen);
 	}
-	CheckSum = ID + msgLen + Fun + MemAddr;
-	u8 i = 0;
-	if(nDat){
-		for(i=0; i<nLen; i++){
-			CheckSum += nDat[i];
-		}
-		writeSCS(nDat, nLen);
+	TxFrame[3] = msgLen;
+	sendFrame();
+}
+
+// Fill in the checksum of the frame in TxFrame and write it
+int SCS::sendFrame()
+{
+	int Len = TxFrame[3]+4;
+	u8 CheckSum = 0;
+	for(int i=2; i<Len-1; i++){
+		CheckSum += TxFrame[i];
 	}
-	writeSCS(~CheckSum);
+	TxFrame[Len-1] = ~CheckSum;
+	return writeSCS(TxFrame, Len);
 }
 
 // Normal write command
@@ -118,33 +121,40 @@ int SCS::RegWriteAction(u8 ID)
 
 // Synchronous write command
 // Servo ID[] array, IDN array length, MemAddr memory table address, write data, write length
+// No servo answers a broadcast, so this returns once the frame is queued
+// and the next request follows it on the wire without a gap.
 void SCS::syncWrite(u8 ID[], u8 IDN, u8 MemAddr, u8 *nDat, u8 nLen)
 {
 	rFlushSCS();
-	u8 mesLen = ((nLen+1)*IDN+4);
-	u8 Sum = 0;
-	u8 bBuf[7];
-	bBuf[0] = 0xff;
-	bBuf[1] = 0xff;
-	bBuf[2] = 0xfe;
-	bBuf[3] = mesLen;
-	bBuf[4] = INST_SYNC_WRITE;
-	bBuf[5] = MemAddr;
-	bBuf[6] = nLen;
-	writeSCS(bBuf, 7);
+	u8 *Dat = syncWriteFrame(ID, IDN, MemAddr, nLen);
+	if(Dat==NULL){
+		return;
+	}
+	for(u8 i=0; i<IDN; i++){
+		memcpy(Dat+i*(nLen+1), nDat+i*nLen, nLen);
+	}
+	sendFrame();
+}
 
-	Sum = 0xfe + mesLen + INST_SYNC_WRITE + MemAddr + nLen;
-	u8 i, j;
-	for(i=0; i<IDN; i++){
-		writeSCS(ID[i]);
-		writeSCS(nDat+i*nLen, nLen);
-		Sum += ID[i];
-		for(j=0; j<nLen; j++){
-			Sum += nDat[i*nLen+j];
-		}
+// Header and servo IDs of a sync write, the caller fills in nLen bytes
+// after each ID and calls sendFrame
+u8 *SCS::syncWriteFrame(u8 ID[], u8 IDN, u8 MemAddr, u8 nLen)
+{
+	int mesLen = (nLen+1)*IDN+4;
+	if(mesLen>SCS_MAX_FRAME-4){
+		return NULL;
 	}
-	writeSCS(~Sum);
-	wFlushSCS();
+	TxFrame[0] = 0xff;
+	TxFrame[1] = 0xff;
+	TxFrame[2] = 0xfe;
+	TxFrame[3] = mesLen;
+	TxFrame[4] = INST_SYNC_WRITE;
+	TxFrame[5] = MemAddr;
+	TxFrame[6] = nLen;
+	for(u8 i=0; i<IDN; i++){
+		TxFrame[7+i*(nLen+1)] = ID[i];
+	}
+	return TxFrame+8;
 }
 
 int SCS::writeByte(u8 ID, u8 MemAddr, u8 bDat)
@@ -172,32 +182,10 @@ int SCS::Read(u8 ID, u8 MemAddr, u8 *nData, u8 nLen)
 	rFlushSCS();
 	writeBuf(ID, MemAddr, &nLen, 1, INST_READ);
 	wFlushSCS();
-	if(!checkHead()){
-		return 0;
-	}
-	u8 bBuf[4];
-	Error = 0;
-	if(readSCS(bBuf, 3)!=3){
-		return 0;
-	}
-	int Size = readSCS(nData, nLen);
-	if(Size!=nLen){
-		return 0;
-	}
-	if(readSCS(bBuf+3, 1)!=1){
-		return 0;
-	}
-	u8 calSum = bBuf[0]+bBuf[1]+bBuf[2];
-	u8 i;
-	for(i=0; i<Size; i++){
-		calSum += nData[i];
-	}
-	calSum = ~calSum;
-	if(calSum!=bBuf[3]){
+	if(readReply(nData, nLen)!=ID){
 		return 0;
 	}
-	Error = bBuf[2];
-	return Size;
+	return nLen;
 }
 
 // Read 1 byte, return -1 if timeout
@@ -231,121 +219,106 @@ int	SCS::Ping(u8 ID)
 	rFlushSCS();
 	writeBuf(ID, 0, NULL, 0, INST_PING);
 	wFlushSCS();
-	Error = 0;
-	if(!checkHead()){
-		return -1;
-	}
-	u8 bBuf[4];
-	if(readSCS(bBuf, 4)!=4){
-		return -1;
-	}
-	if(bBuf[0]!=ID && ID!=0xfe){
+	int RxID = readReply(NULL, 0);
+	if(RxID<0){
 		return -1;
 	}
-	if(bBuf[1]!=2){
+	if(RxID!=ID && ID!=0xfe){
 		return -1;
 	}
-	u8 calSum = ~(bBuf[0]+bBuf[1]+bBuf[2]);
-	if(calSum!=bBuf[3]){
-		return -1;			
-	}
-	Error = bBuf[2];
-	return bBuf[0];
+	return RxID;
 }
 
-int SCS::checkHead()
+int	SCS::Ack(u8 ID)
 {
-	u8 bDat;
-	u8 bBuf[2] = {0, 0};
-	u8 Cnt = 0;
-	while(1){
-		if(!readSCS(&bDat, 1)){
-			return 0;
-		}
-		bBuf[1] = bBuf[0];
-		bBuf[0] = bDat;
-		if(bBuf[0]==0xff && bBuf[1]==0xff){
-			break;
-		}
-		Cnt++;
-		if(Cnt>10){
+	Error = 0;
+	if(ID!=0xfe && Level){
+		if(readReply(NULL, 0)!=ID){
 			return 0;
 		}
 	}
 	return 1;
 }
 
-int	SCS::Ack(u8 ID)
+// Read a reply frame FF FF ID LEN ERR params CHK with nLen parameters in
+// one readSCS call. Bytes ahead of the header, left from an earlier reply,
+// are skipped and the rest of the frame read after them. Parameters are
+// copied to nDat unless it is NULL.
+int SCS::readReply(u8 *nDat, u8 nLen)
 {
+	u8 Frame[SCS_MAX_REPLY+6];
+	int Len = nLen+6;
 	Error = 0;
-	if(ID!=0xfe && Level){
-		if(!checkHead()){
-			return 0;
-		}
-		u8 bBuf[4];
-		if(readSCS(bBuf, 4)!=4){
-			return 0;
-		}
-		if(bBuf[0]!=ID){
-			return 0;
-		}
-		if(bBuf[1]!=2){
-			return 0;
-		}
-		u8 calSum = ~(bBuf[0]+bBuf[1]+bBuf[2]);
-		if(calSum!=bBuf[3]){
-			return 0;			
-		}
-		Error = bBuf[2];
+	if(nLen>SCS_MAX_REPLY){
+		return -2;
 	}
-	return 1;
+	int Size = readSCS(Frame, Len);
+	int Skip = 0;
+	while(Skip+2<Size && !(Frame[Skip]==0xff && Frame[Skip+1]==0xff && Frame[Skip+2]!=0xff)){
+		Skip++;
+	}
+	if(Skip>0){
+		memmove(Frame, Frame+Skip, Size-Skip);
+		Size -= Skip;
+		Size += readSCS(Frame+Size, Len-Size);
+	}
+	if(Size!=Len){
+		return -1;
+	}
+	if(Frame[0]!=0xff || Frame[1]!=0xff || Frame[3]!=nLen+2){
+		return -2;
+	}
+	u8 calSum = 0;
+	for(int i=2; i<Len-1; i++){
+		calSum += Frame[i];
+	}
+	calSum = ~calSum;
+	if(calSum!=Frame[Len-1]){
+		return -2;
+	}
+	Error = Frame[4];
+	if(nDat){
+		memcpy(nDat, Frame+5, nLen);
+	}
+	return Frame[2];
 }
 
 int	SCS::syncReadPacketTx(u8 ID[], u8 IDN, u8 MemAddr, u8 nLen)
 {
 	syncReadRxPacketLen = nLen;
-	u8 checkSum = (4+0xfe)+IDN+MemAddr+nLen+INST_SYNC_READ;
-	u8 i;
-	writeSCS(0xff);
-	writeSCS(0xff);
-	writeSCS(0xfe);
-	writeSCS(IDN+4);
-	writeSCS(INST_SYNC_READ);
-	writeSCS(MemAddr);
-	writeSCS(nLen);
-	for(i=0; i<IDN; i++){
-		writeSCS(ID[i]);
-		checkSum += ID[i];
+	if(IDN>SCS_MAX_FRAME-8){
+		return 0;
 	}
-	checkSum = ~checkSum;
-	writeSCS(checkSum);
+	TxFrame[0] = 0xff;
+	TxFrame[1] = 0xff;
+	TxFrame[2] = 0xfe;
+	TxFrame[3] = IDN+4;
+	TxFrame[4] = INST_SYNC_READ;
+	TxFrame[5] = MemAddr;
+	TxFrame[6] = nLen;
+	memcpy(TxFrame+7, ID, IDN);
+	sendFrame();
 	return nLen;
 }
 
 int SCS::syncReadPacketRx(u8 ID, u8 *nDat)
 {
-	syncReadRxPacket = nDat;
-	syncReadRxPacketIndex = 0;
-	u8 bBuf[4];
-	if(!checkHead()){
-		return 0;
-	}
-	if(readSCS(bBuf, 3)!=3){
-		return 0;
-	}
-	if(bBuf[0]!=ID){
-		return 0;
-	}
-	if(bBuf[1]!=(syncReadRxPacketLen+2)){
-		return 0;
-	}
-	Error = bBuf[2];
-	if(readSCS(nDat, syncReadRxPacketLen)!=syncReadRxPacketLen){
+	if(syncReadPacketRxNext(nDat)!=ID){
 		return 0;
 	}
 	return syncReadRxPacketLen;
 }
 
+// Receive whichever synchronous read reply comes next, return its servo ID,
+// -1 on timeout or -2 for a bad packet. Servos that do not answer leave a gap,
+// so the next reply is not necessarily from the next requested ID.
+int SCS::syncReadPacketRxNext(u8 *nDat)
+{
+	syncReadRxPacket = nDat;
+	syncReadRxPacketIndex = 0;
+	return readReply(nDat, syncReadRxPacketLen);
+}
+
 int SCS::syncReadRxPacketToByte()
 {
 	if(syncReadRxPacketIndex>=syncReadRxPacketLen){
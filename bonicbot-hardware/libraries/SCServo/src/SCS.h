@@ -8,6 +8,12 @@
 
 #include "INST.h"
 
+// Largest parameter block of a reply frame readReply accepts
+#define SCS_MAX_REPLY 64
+
+// Longest instruction frame, the length byte counts at most 255
+#define SCS_MAX_FRAME (255+4)
+
 class SCS{
 public:
 	SCS();
@@ -25,6 +31,7 @@ public:
 	int Ping(u8 ID); // Ping Command
 	int syncReadPacketTx(u8 ID[], u8 IDN, u8 MemAddr, u8 nLen); // Synchronous read instruction packet sending
 	int syncReadPacketRx(u8 ID, u8 *nDat); // Synchronous read return packet reception, successful return memory byte count, failed return 0
+	int syncReadPacketRxNext(u8 *nDat); // Receive the next synchronous read return packet of any servo, return its ID, timeout return -1, bad packet -2
 	int syncReadRxPacketToByte(); // Decode a byte
 	int syncReadRxPacketToWrod(u8 negBit=0); // Decode two bytes, negBit is the direction, negBit=0 means no direction
 public:
@@ -42,10 +49,13 @@ protected:
 	virtual void wFlushSCS() = 0;
 protected:
 	void writeBuf(u8 ID, u8 MemAddr, u8 *nDat, u8 nLen, u8 Fun);
+	u8 *syncWriteFrame(u8 ID[], u8 IDN, u8 MemAddr, u8 nLen); // Lay out a sync write in TxFrame, return where the first servo's data goes, NULL if too long
+	int sendFrame(); // Add the checksum and write TxFrame in one call
 	void Host2SCS(u8 *DataL, u8* DataH, u16 Data); // Split a 16-digit number into two 8-digit numbers
 	u16	SCS2Host(u8 DataL, u8 DataH); // Two 8-digit numbers combined into a 16-digit number
 	int	Ack(u8 ID); // Return Response
-	int checkHead(); // Frame header detection
+	int readReply(u8 *nDat, u8 nLen); // Read a whole reply frame with nLen parameters, return the servo ID, timeout -1, bad frame -2
+	u8 TxFrame[SCS_MAX_FRAME]; // Outgoing frame, assembled in place
 };
 
 #endif
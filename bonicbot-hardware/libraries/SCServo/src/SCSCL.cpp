@@ -56,8 +56,12 @@ int SCSCL::CalibrationOfs(u8 ID){
 
 void SCSCL::SyncWritePos(u8 ID[], u8 IDN, u16 Position[], u16 Time[], u16 Speed[])
 {
-    u8 offbuf[6*IDN];
-    for(u8 i = 0; i<IDN; i++){
+	rFlushSCS();
+	u8 *Dat = syncWriteFrame(ID, IDN, SCSCL_GOAL_POSITION_L, 6);
+	if(Dat==NULL){
+		return;
+	}
+	for(u8 i = 0; i<IDN; i++, Dat+=7){
 		u16 T, V;
 		if(Time){
 			T = Time[i];
@@ -69,11 +73,11 @@ void SCSCL::SyncWritePos(u8 ID[], u8 IDN, u16 Position[], u16 Time[], u16 Speed[
 		}else{
 			V = 0;
 		}
-        Host2SCS(offbuf+i*6+0, offbuf+i*6+1, Position[i]);
-        Host2SCS(offbuf+i*6+2, offbuf+i*6+3, T);
-        Host2SCS(offbuf+i*6+4, offbuf+i*6+5, V);
-    }
-    syncWrite(ID, IDN, SCSCL_GOAL_POSITION_L, offbuf, 6);
+		Host2SCS(Dat+0, Dat+1, Position[i]);
+		Host2SCS(Dat+2, Dat+3, T);
+		Host2SCS(Dat+4, Dat+5, V);
+	}
+	sendFrame();
 }
 
 int SCSCL::PWMMode(u8 ID)
@@ -5,50 +5,131 @@
 
 #include "SCSerial.h"
 
+#if defined(ESP32)
+#include <esp_rom_sys.h>
+#endif
+
 SCSerial::SCSerial()
 {
 	IOTimeOut = 100;
+	IOTimeOutUs = 0;
+	ByteTimeUs = 0;
+	ReplyUs = 0;
 	pSerial = NULL;
+#if defined(ESP32)
+	RxEvent = NULL;
+#endif
 }
 
 SCSerial::SCSerial(u8 End):SCS(End)
 {
 	IOTimeOut = 100;
+	IOTimeOutUs = 0;
+	ByteTimeUs = 0;
+	ReplyUs = 0;
 	pSerial = NULL;
+#if defined(ESP32)
+	RxEvent = NULL;
+#endif
 }
 
 SCSerial::SCSerial(u8 End, u8 Level):SCS(End, Level)
 {
 	IOTimeOut = 100;
+	IOTimeOutUs = 0;
+	ByteTimeUs = 0;
+	ReplyUs = 0;
 	pSerial = NULL;
+#if defined(ESP32)
+	RxEvent = NULL;
+#endif
+}
+
+// Attach a started port. Read timeouts then include the wire time of the
+// expected bytes, and on ESP32 waits block on UART receive events instead
+// of polling.
+void SCSerial::begin(HardwareSerial *Serial, unsigned long Baud)
+{
+	pSerial = Serial;
+	ByteTimeUs = (10*1000000UL+Baud-1)/Baud; // 8N1
+#if defined(ESP32)
+	if(RxEvent==NULL){
+		RxEvent = xSemaphoreCreateBinary();
+	}
+	SemaphoreHandle_t Event = RxEvent;
+	pSerial->onReceive([Event](){
+		xSemaphoreGive(Event);
+	}, false);
+#endif
 }
 
+// Read nLen bytes, giving up the reply timeout plus their wire time after the call.
+// A complete read leaves the time the first byte took in ReplyUs.
 int SCSerial::readSCS(unsigned char *nDat, int nLen)
 {
 	int Size = 0;
-	int ComData;
-	unsigned long t_begin = millis();
-	unsigned long t_user;
-	while(1){
-		ComData = pSerial->read();
-		if(ComData!=-1){
+	unsigned long TimeOutUs = IOTimeOutUs ? IOTimeOutUs : IOTimeOut*1000;
+	unsigned long Budget = TimeOutUs + nLen*ByteTimeUs;
+	unsigned long t_begin = micros();
+	while(Size<nLen){
+		int n = pSerial->available();
+		if(n>0){
+			if(n>nLen-Size){
+				n = nLen-Size;
+			}
 			if(nDat){
-				nDat[Size] = ComData;
+				n = pSerial->readBytes((char *)nDat+Size, n);
+			}else{
+				for(int i=0; i<n; i++){
+					pSerial->read();
+				}
 			}
-			Size++;
-			t_begin = millis();
-		}
-		if(Size>=nLen){
-			break;
+			Size += n;
+			continue;
 		}
-		t_user = millis() - t_begin;
-		if(t_user>IOTimeOut){
+		unsigned long t_user = micros() - t_begin;
+		if(t_user>=Budget){
 			break;
 		}
+		waitSCS(Budget-t_user);
+	}
+	if(Size==nLen){
+		unsigned long t_user = micros() - t_begin;
+		unsigned long t_wire = nLen*ByteTimeUs;
+		ReplyUs = t_user>t_wire ? t_user-t_wire : 0;
 	}
 	return Size;
 }
 
+// Block until data arrives or Us passed. Whole ticks are spent blocked on
+// the RX event; a wait shorter than a tick polls the port in byte-time
+// steps, so short reply timeouts are kept to the microsecond. Without RX
+// events this only yields and the caller polls.
+void SCSerial::waitSCS(unsigned long Us)
+{
+#if defined(ESP32)
+	if(RxEvent){
+		unsigned long TickUs = portTICK_PERIOD_MS*1000UL;
+		if(Us>=TickUs){
+			xSemaphoreTake(RxEvent, Us/TickUs);
+			return;
+		}
+		unsigned long Step = ByteTimeUs ? ByteTimeUs : 10;
+		unsigned long t_begin = micros();
+		while(pSerial->available()==0){
+			unsigned long t_user = micros() - t_begin;
+			if(t_user>=Us){
+				break;
+			}
+			esp_rom_delay_us(Us-t_user<Step ? Us-t_user : Step);
+		}
+		return;
+	}
+#endif
+	(void)Us;
+	yield();
+}
+
 int SCSerial::writeSCS(unsigned char *nDat, int nLen)
 {
 	if(nDat==NULL){
@@ -65,8 +146,16 @@ int SCSerial::writeSCS(unsigned char bDat)
 void SCSerial::rFlushSCS()
 {
 	while(pSerial->read()!=-1);
+#if defined(ESP32)
+	if(RxEvent){
+		xSemaphoreTake(RxEvent, 0);
+	}
+#endif
 }
 
+// Wait until the request is on the wire, so reply timeouts start when the
+// servo can first answer
 void SCSerial::wFlushSCS()
 {
+	pSerial->flush();
 }
\ No newline at end of file
@@ -20,6 +20,7 @@ public:
 	SCSerial();
 	SCSerial(u8 End);
 	SCSerial(u8 End, u8 Level);
+	void begin(HardwareSerial *Serial, unsigned long Baud); // Attach an already started port, enables RX events on ESP32
 
 protected:
 	virtual int writeSCS(unsigned char *nDat, int nLen); // Output nLen bytes
@@ -27,10 +28,18 @@ protected:
 	virtual int writeSCS(unsigned char bDat); // Output 1 byte
 	virtual void rFlushSCS();
 	virtual void wFlushSCS();
+	void waitSCS(unsigned long Us); // Wait up to Us for received data
 public:
-	unsigned long int IOTimeOut; // Input and output timeout
+	unsigned long int IOTimeOut; // Reply latency timeout in ms, used while IOTimeOutUs is 0
+	unsigned long int IOTimeOutUs; // Reply latency timeout in us, 0 to use IOTimeOut. The wire time of the expected bytes is added
+	unsigned long int ByteTimeUs; // Wire time of one byte, set by begin
+	unsigned long int ReplyUs; // Latency of the last complete read, its wire time excluded
 	HardwareSerial *pSerial; // Serial port pointer
 	int Err;
+#if defined(ESP32)
+private:
+	SemaphoreHandle_t RxEvent; // Given by the UART event task when data arrives
+#endif
 public:
 	virtual int getErr(){  return Err;  }
 };
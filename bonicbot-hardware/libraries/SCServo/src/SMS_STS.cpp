@@ -48,13 +48,19 @@ int SMS_STS::RegWritePosEx(u8 ID, s16 Position, u16 Speed, u8 ACC)
 	return regWrite(ID, SMS_STS_ACC, bBuf, 7);
 }
 
+// Position, speed and acceleration are encoded straight into the frame
 void SMS_STS::SyncWritePosEx(u8 ID[], u8 IDN, s16 Position[], u16 Speed[], u8 ACC[])
 {
-    u8 offbuf[7*IDN];
-    for(u8 i = 0; i<IDN; i++){
+	rFlushSCS();
+	u8 *Dat = syncWriteFrame(ID, IDN, SMS_STS_ACC, 7);
+	if(Dat==NULL){
+		return;
+	}
+	for(u8 i = 0; i<IDN; i++, Dat+=8){
+		u16 Pos = Position[i];
 		if(Position[i]<0){
-			Position[i] = -Position[i];
-			Position[i] |= (1<<15);
+			Pos = -Position[i];
+			Pos |= (1<<15);
 		}
 		u16 V;
 		if(Speed){
@@ -63,15 +69,15 @@ void SMS_STS::SyncWritePosEx(u8 ID[], u8 IDN, s16 Position[], u16 Speed[], u8 AC
 			V = 0;
 		}
 		if(ACC){
-			offbuf[i*7] = ACC[i];
+			Dat[0] = ACC[i];
 		}else{
-			offbuf[i*7] = 0;
+			Dat[0] = 0;
 		}
-        Host2SCS(offbuf+i*7+1, offbuf+i*7+2, Position[i]);
-        Host2SCS(offbuf+i*7+3, offbuf+i*7+4, 0);
-        Host2SCS(offbuf+i*7+5, offbuf+i*7+6, V);
-    }
-    syncWrite(ID, IDN, SMS_STS_ACC, offbuf, 7);
+		Host2SCS(Dat+1, Dat+2, Pos);
+		Host2SCS(Dat+3, Dat+4, 0);
+		Host2SCS(Dat+5, Dat+6, V);
+	}
+	sendFrame();
 }
 
 int SMS_STS::WheelMode(u8 ID)
@@ -124,6 +130,69 @@ int SMS_STS::FeedBack(int ID)
 	return nLen;
 }
 
+// Sign-magnitude value with the sign at bit Bit
+static s16 SignedValue(u16 Value, u8 Bit)
+{
+	if(Value&(1<<Bit)){
+		return -(s16)(Value&~(1<<Bit));
+	}
+	return Value;
+}
+
+int SMS_STS::SyncFeedBack(u8 ID[], u8 IDN, SMS_STS_FeedBack FeedBack[], const u32 TimeOutUs[])
+{
+	u8 nDat[sizeof(Mem)];
+	int nAck = 0;
+	u8 i;
+	for(i=0; i<IDN; i++){
+		memset(&FeedBack[i], 0, sizeof(FeedBack[i]));
+		FeedBack[i].Err = 1;
+	}
+	rFlushSCS();
+	syncReadPacketTx(ID, IDN, SMS_STS_PRESENT_POSITION_L, sizeof(nDat));
+	wFlushSCS();
+
+	// Replies come in request order, a silent servo only leaves a gap. It
+	// is given up after its own timeout when TimeOutUs is set. A bad reply
+	// is taken as the expected servo's, which then counts as failed.
+	unsigned long SavedTimeOutUs = IOTimeOutUs;
+	u8 Next = 0;
+	while(Next<IDN){
+		if(TimeOutUs){
+			IOTimeOutUs = TimeOutUs[Next];
+		}
+		int RxID = syncReadPacketRxNext(nDat);
+		if(RxID==-1){
+			Next++;
+			continue;
+		}
+		if(RxID<0){
+			FeedBack[Next].Err = 2;
+			Next++;
+			continue;
+		}
+		for(i=Next; i<IDN && ID[i]!=RxID; i++);
+		if(i==IDN){
+			continue;
+		}
+		Next = i+1;
+		SMS_STS_FeedBack &Fb = FeedBack[i];
+		Fb.Err = 0;
+		Fb.ReplyUs = ReplyUs;
+		Fb.Pos = SignedValue(SCS2Host(nDat[SMS_STS_PRESENT_POSITION_L-SMS_STS_PRESENT_POSITION_L], nDat[SMS_STS_PRESENT_POSITION_H-SMS_STS_PRESENT_POSITION_L]), 15);
+		Fb.Speed = SignedValue(SCS2Host(nDat[SMS_STS_PRESENT_SPEED_L-SMS_STS_PRESENT_POSITION_L], nDat[SMS_STS_PRESENT_SPEED_H-SMS_STS_PRESENT_POSITION_L]), 15);
+		Fb.Load = SignedValue(SCS2Host(nDat[SMS_STS_PRESENT_LOAD_L-SMS_STS_PRESENT_POSITION_L], nDat[SMS_STS_PRESENT_LOAD_H-SMS_STS_PRESENT_POSITION_L]), 10);
+		Fb.Voltage = nDat[SMS_STS_PRESENT_VOLTAGE-SMS_STS_PRESENT_POSITION_L];
+		Fb.Temper = nDat[SMS_STS_PRESENT_TEMPERATURE-SMS_STS_PRESENT_POSITION_L];
+		Fb.Move = nDat[SMS_STS_MOVING-SMS_STS_PRESENT_POSITION_L];
+		Fb.Current = SignedValue(SCS2Host(nDat[SMS_STS_PRESENT_CURRENT_L-SMS_STS_PRESENT_POSITION_L], nDat[SMS_STS_PRESENT_CURRENT_H-SMS_STS_PRESENT_POSITION_L]), 15);
+		nAck++;
+	}
+	IOTimeOutUs = SavedTimeOutUs;
+	Err = (nAck==IDN) ? 0 : 1;
+	return nAck;
+}
+
 int SMS_STS::ReadPos(int ID)
 {
 	int Pos = -1;
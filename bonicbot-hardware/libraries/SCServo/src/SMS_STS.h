@@ -52,6 +52,20 @@
 
 #include "SCSerial.h"
 
+// Feedback of one servo read by SyncFeedBack
+struct SMS_STS_FeedBack
+{
+	s16 Pos;
+	s16 Speed;
+	s16 Load;
+	u8 Voltage; // 0.1 V
+	u8 Temper;
+	u8 Move;
+	s16 Current;
+	u32 ReplyUs; // Latency after the request or the previous reply
+	u8 Err; // 1 if the servo did not answer, 2 if its reply was bad, the other fields are then 0
+};
+
 class SMS_STS : public SCSerial
 {
 public:
@@ -76,6 +90,7 @@ public:
 	virtual int ReadMove(int ID);//读移动状态
 	virtual int ReadCurrent(int ID);//读电流
 	virtual int ReadMode(int ID);
+	virtual int SyncFeedBack(u8 ID[], u8 IDN, SMS_STS_FeedBack FeedBack[], const u32 TimeOutUs[] = NULL);//同步读多个舵机反馈, 返回应答舵机数
 private:
 	u8 Mem[SMS_STS_PRESENT_CURRENT_H-SMS_STS_PRESENT_POSITION_L+1];
 };
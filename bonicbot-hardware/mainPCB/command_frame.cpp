@@ -0,0 +1,144 @@
+#include "command_frame.h"
+
+static uint16_t readU16(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// Allowed servos for each group id
+static bool groupMask(uint8_t group, uint16_t &mask)
+{
+  switch (group)
+  {
+  case FRAME_GROUP_RIGHT_HAND:
+    mask = RIGHT_HAND_MASK;
+    return true;
+  case FRAME_GROUP_LEFT_HAND:
+    mask = LEFT_HAND_MASK;
+    return true;
+  case FRAME_GROUP_HEAD:
+    mask = HEAD_MASK;
+    return true;
+  case FRAME_GROUP_ALL:
+    mask = ALL_SERVOS_MASK;
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool decodeServoRecords(const uint8_t *p, size_t len, uint16_t mask, uint8_t flags, ServoTargets &targets, size_t &consumed)
+{
+  size_t recordSize = 2;
+  if (flags & FRAME_FLAG_SPEED)
+    recordSize += 2;
+  if (flags & FRAME_FLAG_ACC)
+    recordSize += 1;
+
+  size_t needed = 0;
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    if (mask & (1 << i))
+      needed += recordSize;
+  }
+  if (len < needed)
+    return false;
+  consumed = needed;
+
+  targets.mask = mask;
+  targets.speedMask = (flags & FRAME_FLAG_SPEED) ? mask : 0;
+  targets.accMask = (flags & FRAME_FLAG_ACC) ? mask : 0;
+
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    if (!(mask & (1 << i)))
+      continue;
+
+    targets.angle[i] = (int16_t)readU16(p);
+    p += 2;
+    if (flags & FRAME_FLAG_SPEED)
+    {
+      targets.speed[i] = readU16(p);
+      p += 2;
+    }
+    if (flags & FRAME_FLAG_ACC)
+    {
+      targets.acc[i] = *p++;
+    }
+  }
+
+  return true;
+}
+
+// Decode a binary frame, returns false for malformed frames
+bool decodeCommandFrame(const uint8_t *data, size_t len, CommandFrame &frame)
+{
+  if (!isCommandFrame(data, len))
+    return false;
+
+  frame.opcode = data[1];
+  frame.hasBase = false;
+  uint8_t group = data[2];
+  uint16_t mask = readU16(data + 3);
+  uint8_t flags = data[5];
+  const uint8_t *body = data + FRAME_HEADER_SIZE;
+  size_t bodyLen = len - FRAME_HEADER_SIZE;
+  size_t consumed;
+
+  frame.seq = 0;
+  frame.executeAt = 0;
+
+  frame.sequenced = (flags & FRAME_FLAG_SEQ) != 0;
+  if (frame.sequenced)
+  {
+    if (bodyLen < 2)
+      return false;
+    frame.seq = readU16(body);
+    body += 2;
+    bodyLen -= 2;
+  }
+
+  frame.scheduled = (flags & FRAME_FLAG_AT) != 0;
+  if (frame.scheduled)
+  {
+    if (bodyLen < 4)
+      return false;
+    frame.executeAt = readU16(body) | ((uint32_t)readU16(body + 2) << 16);
+    body += 4;
+    bodyLen -= 4;
+  }
+
+  switch (frame.opcode)
+  {
+  case FRAME_OP_SERVOS:
+  {
+    uint16_t allowed;
+    if (!groupMask(group, allowed) || mask == 0 || (mask & ~allowed))
+      return false;
+    return decodeServoRecords(body, bodyLen, mask, flags, frame.servos, consumed);
+  }
+  case FRAME_OP_BASE:
+    if (bodyLen < 4)
+      return false;
+    frame.leftSpeed = (int16_t)readU16(body);
+    frame.rightSpeed = (int16_t)readU16(body + 2);
+    frame.hasBase = true;
+    return true;
+  case FRAME_OP_BODY:
+    if (group != FRAME_GROUP_ALL || (mask & ~ALL_SERVOS_MASK))
+      return false;
+    if (!decodeServoRecords(body, bodyLen, mask, flags, frame.servos, consumed))
+      return false;
+    if (flags & FRAME_FLAG_BASE)
+    {
+      if (bodyLen - consumed < 4)
+        return false;
+      frame.leftSpeed = (int16_t)readU16(body + consumed);
+      frame.rightSpeed = (int16_t)readU16(body + consumed + 2);
+      frame.hasBase = true;
+    }
+    return mask != 0 || frame.hasBase;
+  default:
+    return false;
+  }
+}
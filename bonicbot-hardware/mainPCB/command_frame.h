@@ -0,0 +1,79 @@
+#ifndef COMMAND_FRAME_H
+#define COMMAND_FRAME_H
+
+#include <Arduino.h>
+#include "configs.h"
+#include "servo_control.h"
+
+// ======================================================================
+// Binary Command Frame
+// ======================================================================
+// Fixed-layout alternative to JSON on COMMAND_CHAR_UUID, detected by the
+// first byte (JSON commands always start with '{'). All values are little
+// endian.
+//
+//   [0]    magic + version (FRAME_MAGIC_V1)
+//   [1]    opcode (FRAME_OP_*)
+//   [2]    group id (FRAME_GROUP_*)
+//   [3..4] servo bitmask, bit n = SERVO_NAMES[n]
+//   [5]    flags (FRAME_FLAG_*)
+//
+// With FRAME_FLAG_SEQ a u16 sequence id follows the header, then with
+// FRAME_FLAG_AT a u32 execution time (device micros()), both before the
+// opcode specific body.
+//
+// FRAME_OP_SERVOS is followed by one record per set bit, in index order:
+//   int16 angle in centidegrees, u16 speed (FRAME_FLAG_SPEED),
+//   u8 acc (FRAME_FLAG_ACC)
+// A six servo arm pose without speed/acc is 18 bytes.
+//
+// FRAME_OP_BASE is followed by int16 left speed and int16 right speed.
+//
+// FRAME_OP_BODY uses FRAME_GROUP_ALL and carries servo records for any
+// subset of the 14 servos (the mask may be empty), followed by the base
+// speeds when FRAME_FLAG_BASE is set. Both are executed back to back.
+
+#define FRAME_MAGIC_V1 0xB1
+#define FRAME_HEADER_SIZE 6
+
+// Opcodes
+#define FRAME_OP_SERVOS 0x01
+#define FRAME_OP_BASE 0x02
+#define FRAME_OP_BODY 0x03
+
+// Group ids
+#define FRAME_GROUP_RIGHT_HAND 0x00
+#define FRAME_GROUP_LEFT_HAND 0x01
+#define FRAME_GROUP_HEAD 0x02
+#define FRAME_GROUP_ALL 0xFF
+
+// Flags
+#define FRAME_FLAG_SPEED 0x01
+#define FRAME_FLAG_ACC 0x02
+#define FRAME_FLAG_BASE 0x04
+#define FRAME_FLAG_SEQ 0x08
+#define FRAME_FLAG_AT 0x10
+
+struct CommandFrame
+{
+  uint8_t opcode;
+  ServoTargets servos;
+  int16_t leftSpeed;
+  int16_t rightSpeed;
+  bool hasBase;
+  bool sequenced;
+  uint16_t seq;
+  bool scheduled;
+  uint32_t executeAt;
+};
+
+// Check whether a received buffer is a binary frame
+inline bool isCommandFrame(const uint8_t *data, size_t len)
+{
+  return len >= FRAME_HEADER_SIZE && data[0] == FRAME_MAGIC_V1;
+}
+
+// Decode a binary frame, returns false for malformed frames
+bool decodeCommandFrame(const uint8_t *data, size_t len, CommandFrame &frame);
+
+#endif // COMMAND_FRAME_H
@@ -0,0 +1,166 @@
+#include "command_schedule.h"
+#include <esp_timer.h>
+#include "debug_log.h"
+
+static portMUX_TYPE scheduleLock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t scheduleTimer = nullptr;
+static CommandScheduleStats stats = {};
+
+// Command pool, order[] holds the used slots sorted by deadline
+static ControlCommand entries[SCHEDULE_CAPACITY];
+static uint32_t deadlines[SCHEDULE_CAPACITY];
+static bool used[SCHEDULE_CAPACITY] = {};
+static uint8_t order[SCHEDULE_CAPACITY];
+static uint8_t count = 0;
+
+// Signed distance between two micros() values, wrap safe
+static int32_t timeUntil(uint32_t deadline, uint32_t now)
+{
+  return (int32_t)(deadline - now);
+}
+
+// Arm the timer for the earliest deadline, call with scheduleLock held
+static void armTimer(uint32_t now)
+{
+  esp_timer_stop(scheduleTimer);
+  if (count == 0)
+    return;
+
+  int32_t delay = timeUntil(deadlines[order[0]], now);
+  esp_timer_start_once(scheduleTimer, delay > 0 ? delay : 0);
+}
+
+// Report a command as late instead of executing it
+static void reportLate(ControlCommand &command, uint32_t lateUs)
+{
+  portENTER_CRITICAL(&scheduleLock);
+  stats.late++;
+  portEXIT_CRITICAL(&scheduleLock);
+
+  command.late.kind = command.kind;
+  command.late.lateUs = lateUs;
+  command.kind = CONTROL_LATE;
+  enqueueControlCommand(command);
+}
+
+// Hand every due command to the control queue, one at a time so the
+// critical section stays short
+static void onScheduleTimer(void *param)
+{
+  for (;;)
+  {
+    ControlCommand command;
+    uint32_t deadline;
+    uint32_t now = micros();
+
+    portENTER_CRITICAL(&scheduleLock);
+    if (count == 0 || timeUntil(deadlines[order[0]], now) > 0)
+    {
+      armTimer(now);
+      portEXIT_CRITICAL(&scheduleLock);
+      return;
+    }
+
+    uint8_t slot = order[0];
+    command = entries[slot];
+    deadline = deadlines[slot];
+    used[slot] = false;
+    count--;
+    memmove(order, order + 1, count);
+    portEXIT_CRITICAL(&scheduleLock);
+
+    uint32_t lateUs = -timeUntil(deadline, now);
+    if (lateUs > SCHEDULE_LATE_US)
+    {
+      reportLate(command, lateUs);
+      continue;
+    }
+
+    portENTER_CRITICAL(&scheduleLock);
+    stats.fired++;
+    if (lateUs > stats.maxFireErrorUs)
+      stats.maxFireErrorUs = lateUs;
+    portEXIT_CRITICAL(&scheduleLock);
+
+    // Latency of a scheduled command is measured from its deadline
+    command.receivedAt = deadline;
+    command.scheduled = false;
+    enqueueControlCommand(command);
+  }
+}
+
+// Create the deadline timer
+void initializeCommandSchedule()
+{
+  esp_timer_create_args_t args = {};
+  args.callback = onScheduleTimer;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "schedule";
+  esp_timer_create(&args, &scheduleTimer);
+
+  LOG_INFO(SCHEDULE_READY);
+}
+
+// Hold a command until micros() reaches executeAt
+bool scheduleControlCommand(ControlCommand &command, uint32_t executeAt)
+{
+  uint32_t now = micros();
+  int32_t ahead = timeUntil(executeAt, now);
+
+  if (-ahead > SCHEDULE_LATE_US)
+  {
+    reportLate(command, -ahead);
+    return false;
+  }
+
+  portENTER_CRITICAL(&scheduleLock);
+  if (count >= SCHEDULE_CAPACITY || ahead > (int32_t)SCHEDULE_MAX_AHEAD_MS * 1000)
+  {
+    stats.rejected++;
+    portEXIT_CRITICAL(&scheduleLock);
+
+    LOG_WARN(SCHEDULE_REJECTED);
+    return false;
+  }
+
+  uint8_t slot = 0;
+  while (used[slot])
+    slot++;
+  used[slot] = true;
+  entries[slot] = command;
+  deadlines[slot] = executeAt;
+
+  // Insert after every entry with an earlier or equal deadline
+  uint8_t pos = count;
+  while (pos > 0 && timeUntil(executeAt, deadlines[order[pos - 1]]) < 0)
+  {
+    order[pos] = order[pos - 1];
+    pos--;
+  }
+  order[pos] = slot;
+  count++;
+
+  stats.scheduled++;
+  if (pos == 0)
+    armTimer(now);
+  portEXIT_CRITICAL(&scheduleLock);
+
+  return true;
+}
+
+// Schedule the command if it has an execution time, else queue it now
+bool submitControlCommand(ControlCommand &command)
+{
+  if (command.scheduled)
+    return scheduleControlCommand(command, command.executeAt);
+  return enqueueControlCommand(command);
+}
+
+// Snapshot of schedule statistics
+void getCommandScheduleStats(CommandScheduleStats &out)
+{
+  portENTER_CRITICAL(&scheduleLock);
+  out = stats;
+  out.depth = count;
+  portEXIT_CRITICAL(&scheduleLock);
+}
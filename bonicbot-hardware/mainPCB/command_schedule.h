@@ -0,0 +1,45 @@
+#ifndef COMMAND_SCHEDULE_H
+#define COMMAND_SCHEDULE_H
+
+#include <Arduino.h>
+#include "configs.h"
+#include "control_task.h"
+
+// ======================================================================
+// Command Schedule
+// ======================================================================
+// Commands tagged with an execution time ("at" in JSON, FRAME_FLAG_AT in
+// binary frames) are held in a fixed-capacity queue sorted by deadline. A
+// one-shot esp_timer is armed for the earliest deadline and hands each
+// command to the control queue when it is due, so BLE connection-interval
+// jitter no longer shifts motion timing.
+//
+// Deadlines are micros() values of the device clock (the hello reply
+// carries it). A command that is more than SCHEDULE_LATE_US past its
+// deadline, on arrival or when the timer fires, is not executed; a "late"
+// status with its seq is sent instead.
+
+struct CommandScheduleStats
+{
+  uint32_t scheduled; // commands accepted into the schedule
+  uint32_t fired;     // commands handed to the control queue on time
+  uint32_t late;      // commands reported late instead of executed
+  uint32_t rejected;  // schedule full or deadline too far ahead
+  uint32_t depth;     // commands currently waiting
+  uint32_t maxFireErrorUs; // largest timer lateness of a fired command
+};
+
+// Create the deadline timer
+void initializeCommandSchedule();
+
+// Hold a command until micros() reaches executeAt, returns false if it
+// was rejected or reported late
+bool scheduleControlCommand(ControlCommand &command, uint32_t executeAt);
+
+// Schedule the command if it has an execution time, else queue it now
+bool submitControlCommand(ControlCommand &command);
+
+// Snapshot of schedule statistics
+void getCommandScheduleStats(CommandScheduleStats &stats);
+
+#endif // COMMAND_SCHEDULE_H
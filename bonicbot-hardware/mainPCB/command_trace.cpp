@@ -0,0 +1,313 @@
+#include "command_trace.h"
+#include "communication.h"
+#include "control_task.h"
+#include "command_schedule.h"
+#include "telemetry_history.h"
+#include "fast_stream.h"
+#include "servo_health.h"
+#include "servo_bus.h"
+
+// Latency stages, each measured between two trace timestamps
+enum LatencyStage
+{
+  STAGE_QUEUE,    // received -> dequeued
+  STAGE_DISPATCH, // dequeued -> bus start
+  STAGE_BUS,      // bus start -> bus done
+  STAGE_TOTAL,    // received -> bus done
+  STAGE_COUNT,
+};
+
+static const char *STAGE_NAMES[STAGE_COUNT] = {"queue", "dispatch", "bus", "total"};
+
+// Last LATENCY_WINDOW samples of one stage
+struct LatencyWindow
+{
+  uint32_t samples[LATENCY_WINDOW];
+  uint16_t next;
+  uint16_t count;
+};
+
+static portMUX_TYPE traceLock = portMUX_INITIALIZER_UNLOCKED;
+static LatencyWindow windows[STAGE_COUNT] = {};
+static uint32_t tracedCommands = 0;
+
+// Pending ack batch, only touched by the control task
+static uint8_t ackBuffer[2 + ACK_BATCH_SIZE * ACK_RECORD_SIZE];
+static uint8_t ackCount = 0;
+static uint32_t ackOldestMs = 0;
+
+static void addSample(LatencyWindow &window, uint32_t value)
+{
+  window.samples[window.next] = value;
+  window.next = (window.next + 1) % LATENCY_WINDOW;
+  if (window.count < LATENCY_WINDOW)
+    window.count++;
+}
+
+// Microseconds from one timestamp to a later one, 0 if it was not later
+// (a coalesced command can arrive after its marker was dequeued)
+static uint32_t elapsed(uint32_t from, uint32_t to)
+{
+  int32_t delta = (int32_t)(to - from);
+  return delta > 0 ? (uint32_t)delta : 0;
+}
+
+static void writeU16(uint8_t *p, uint16_t value)
+{
+  p[0] = value & 0xFF;
+  p[1] = value >> 8;
+}
+
+static void writeU32(uint8_t *p, uint32_t value)
+{
+  writeU16(p, value & 0xFFFF);
+  writeU16(p + 2, value >> 16);
+}
+
+// Queue one ack record, sends the batch once it is full
+static void appendAck(uint16_t seq, uint32_t receivedAt, const CommandTrace &trace, uint8_t flags)
+{
+  if (ackCount == 0)
+    ackOldestMs = millis();
+
+  uint8_t *record = ackBuffer + 2 + ackCount * ACK_RECORD_SIZE;
+  writeU16(record, seq);
+  writeU32(record + 2, receivedAt);
+  writeU32(record + 6, elapsed(receivedAt, trace.dequeuedAt));
+  writeU32(record + 10, elapsed(receivedAt, trace.busStartAt));
+  writeU32(record + 14, elapsed(receivedAt, trace.busDoneAt));
+  record[18] = flags;
+  ackCount++;
+
+  if (ackCount >= ACK_BATCH_SIZE)
+    flushCommandAcks(true);
+}
+
+// Record an executed command, queues an ack if it was sequenced
+void recordCommandTrace(const CommandTrace &trace)
+{
+  uint32_t queue = elapsed(trace.receivedAt, trace.dequeuedAt);
+  uint32_t dispatch = elapsed(trace.dequeuedAt, trace.busStartAt);
+  uint32_t bus = elapsed(trace.busStartAt, trace.busDoneAt);
+  uint32_t total = elapsed(trace.receivedAt, trace.busDoneAt);
+
+  portENTER_CRITICAL(&traceLock);
+  addSample(windows[STAGE_QUEUE], queue);
+  addSample(windows[STAGE_DISPATCH], dispatch);
+  addSample(windows[STAGE_BUS], bus);
+  addSample(windows[STAGE_TOTAL], total);
+  tracedCommands++;
+  portEXIT_CRITICAL(&traceLock);
+
+  for (uint8_t i = 0; i < trace.superseded; i++)
+    appendAck(trace.supersededSeq[i], trace.supersededReceivedAt[i], trace, ACK_FLAG_SUPERSEDED);
+
+  if (trace.sequenced)
+    appendAck(trace.seq, trace.receivedAt, trace, 0);
+}
+
+// Ticks until the pending ack batch is due, portMAX_DELAY if none
+TickType_t commandAckWait()
+{
+  if (ackCount == 0)
+    return portMAX_DELAY;
+
+  uint32_t age = millis() - ackOldestMs;
+  if (age >= ACK_BATCH_MS)
+    return 0;
+  return pdMS_TO_TICKS(ACK_BATCH_MS - age);
+}
+
+// Send the pending ack batch if it is due (or always when forced)
+void flushCommandAcks(bool force)
+{
+  if (ackCount == 0)
+    return;
+  if (!force && millis() - ackOldestMs < ACK_BATCH_MS)
+    return;
+
+  ackBuffer[0] = ACK_MAGIC;
+  ackBuffer[1] = ackCount;
+  sendResponse(ackBuffer, 2 + ackCount * ACK_RECORD_SIZE, LINK_CHANNEL_ACK);
+  ackCount = 0;
+}
+
+// min/avg/p99 of one window
+static void addWindowStats(JsonObject &stage, const LatencyWindow &window)
+{
+  uint32_t sorted[LATENCY_WINDOW];
+  uint16_t count;
+
+  portENTER_CRITICAL(&traceLock);
+  count = window.count;
+  memcpy(sorted, window.samples, count * sizeof(uint32_t));
+  portEXIT_CRITICAL(&traceLock);
+
+  stage["n"] = count;
+  if (count == 0)
+    return;
+
+  // Insertion sort, the window is small and this only runs on request
+  uint64_t sum = 0;
+  for (uint16_t i = 0; i < count; i++)
+  {
+    uint32_t value = sorted[i];
+    sum += value;
+    int j = i - 1;
+    while (j >= 0 && sorted[j] > value)
+    {
+      sorted[j + 1] = sorted[j];
+      j--;
+    }
+    sorted[j + 1] = value;
+  }
+
+  stage["min"] = sorted[0];
+  stage["avg"] = (uint32_t)(sum / count);
+  stage["p99"] = sorted[(count * 99 + 99) / 100 - 1];
+  stage["max"] = sorted[count - 1];
+}
+
+// Latency windows and control queue counters
+bool readDiagnosticsData(JsonObject &diagnostics)
+{
+  JsonObject latency = diagnostics["latencyUs"].to<JsonObject>();
+  for (int i = 0; i < STAGE_COUNT; i++)
+  {
+    JsonObject stage = latency[STAGE_NAMES[i]].to<JsonObject>();
+    addWindowStats(stage, windows[i]);
+  }
+
+  ControlTaskStats stats;
+  getControlTaskStats(stats);
+
+  JsonObject control = diagnostics["control"].to<JsonObject>();
+  control["traced"] = tracedCommands;
+  control["enqueued"] = stats.enqueued;
+  control["dropped"] = stats.dropped;
+  control["executed"] = stats.executed;
+  control["depth"] = stats.depth;
+  control["maxDepth"] = stats.maxDepth;
+  control["supersededUnacked"] = stats.supersededUnacked;
+  control["parserArenaMisses"] = getCommandArenaMisses();
+  control["statusArenaMisses"] = getStatusArenaMisses();
+  control["channelArenaMisses"] = getChannelArenaMisses();
+
+  CommandScheduleStats scheduleStats;
+  getCommandScheduleStats(scheduleStats);
+
+  JsonObject schedule = diagnostics["schedule"].to<JsonObject>();
+  schedule["scheduled"] = scheduleStats.scheduled;
+  schedule["fired"] = scheduleStats.fired;
+  schedule["late"] = scheduleStats.late;
+  schedule["rejected"] = scheduleStats.rejected;
+  schedule["depth"] = scheduleStats.depth;
+  schedule["maxFireErrorUs"] = scheduleStats.maxFireErrorUs;
+
+  // Achieved rate and overruns of the running streams
+  JsonObject telemetry = diagnostics["telemetry"].to<JsonObject>();
+  for (int i = 0; i < STREAM_COUNT; i++)
+  {
+    TelemetryStreamStats streamStats;
+    getTelemetryStreamStats((TelemetryStream)i, streamStats);
+    if (!streamStats.active)
+      continue;
+
+    JsonObject stream = telemetry[streamStats.name].to<JsonObject>();
+    stream["intervalMs"] = streamStats.intervalMs;
+    stream["rateHz"] = streamStats.rateHz;
+    stream["overruns"] = streamStats.overruns;
+    stream["suppressed"] = streamStats.suppressed;
+    stream["lastRunUs"] = streamStats.lastRunUs;
+  }
+
+  HistoryStats historyStats;
+  getHistoryStats(historyStats);
+
+  JsonObject history = diagnostics["history"].to<JsonObject>();
+  history["capacity"] = historyStats.capacity;
+  history["recorded"] = historyStats.recorded;
+  history["psram"] = historyStats.psram;
+  history["downloads"] = historyStats.downloads;
+
+  FastStreamStats fastStats;
+  getFastStreamStats(fastStats);
+
+  JsonObject fast = diagnostics[FAST].to<JsonObject>();
+  fast["active"] = fastStats.active;
+  fast["servos"] = fastStats.mask;
+  fast["requestedMs"] = fastStats.requestedMs;
+  fast["intervalMs"] = fastStats.intervalMs;
+  fast["frames"] = fastStats.frames;
+  fast["cycleUs"] = fastStats.cycleUs;
+  fast["maxCycleUs"] = fastStats.maxCycleUs;
+  fast["degraded"] = fastStats.degraded;
+  fast["overruns"] = fastStats.overruns;
+  fast["writeLoad"] = fastStats.writeLoad;
+
+  ServoBusStats busStats;
+  getServoBusStats(busStats);
+
+  JsonObject servoBus = diagnostics["servoBus"].to<JsonObject>();
+  servoBus["submitted"] = busStats.submitted;
+  servoBus["completed"] = busStats.completed;
+  servoBus["rejected"] = busStats.rejected;
+  servoBus["depth"] = busStats.depth;
+  servoBus["maxDepth"] = busStats.maxDepth;
+  servoBus["busyUs"] = busStats.busyUs;
+  servoBus["targetsBusyUs"] = busStats.targetsBusyUs;
+
+  ServoHealthStats healthStats;
+  getServoHealthStats(healthStats);
+
+  // Per-servo arrays are indexed like SERVO_NAMES
+  JsonObject servoHealth = diagnostics["servoHealth"].to<JsonObject>();
+  servoHealth["quarantined"] = healthStats.quarantined;
+  servoHealth["quarantines"] = healthStats.quarantines;
+  servoHealth["pings"] = healthStats.pings;
+  JsonArray servoLatency = servoHealth["latencyUs"].to<JsonArray>();
+  JsonArray servoTimeout = servoHealth["timeoutUs"].to<JsonArray>();
+  JsonArray servoMissed = servoHealth["missed"].to<JsonArray>();
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    servoLatency.add(healthStats.latencyUs[i]);
+    servoTimeout.add(healthStats.timeoutUs[i]);
+    servoMissed.add(healthStats.missed[i]);
+  }
+
+  LogStats logStats;
+  getLogStats(logStats);
+
+  JsonObject log = diagnostics["log"].to<JsonObject>();
+  log["logged"] = logStats.logged;
+  log["sent"] = logStats.sent;
+  log["suppressed"] = logStats.suppressed;
+  log["dropped"] = logStats.dropped;
+
+#if COMM_METHOD == COMM_METHOD_SERIAL || COMM_METHOD == COMM_METHOD_BOTH
+  UsbLinkStats linkStats;
+  getUsbLinkStats(linkStats);
+
+  JsonObject link = diagnostics["usbLink"].to<JsonObject>();
+  link["rxPackets"] = linkStats.rxPackets;
+  link["crcErrors"] = linkStats.crcErrors;
+  link["overflows"] = linkStats.overflows;
+  link["txPackets"] = linkStats.txPackets;
+#endif
+
+#if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
+  NotifyStats notifyStats[NOTIFY_MAX_CHARACTERISTICS];
+  int notifyCount = getNotifyStats(notifyStats, NOTIFY_MAX_CHARACTERISTICS);
+
+  JsonObject notify = diagnostics["notify"].to<JsonObject>();
+  for (int i = 0; i < notifyCount; i++)
+  {
+    JsonObject characteristic = notify[notifyStats[i].name].to<JsonObject>();
+    characteristic["sent"] = notifyStats[i].sent;
+    characteristic["merged"] = notifyStats[i].merged;
+    characteristic["failed"] = notifyStats[i].failed;
+  }
+#endif
+
+  return true;
+}
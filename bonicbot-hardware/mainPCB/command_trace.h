@@ -0,0 +1,65 @@
+#ifndef COMMAND_TRACE_H
+#define COMMAND_TRACE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "configs.h"
+
+// ======================================================================
+// Command Tracing
+// ======================================================================
+// Every executed command is timestamped (micros()) when it is received,
+// dequeued by the control task, and when its bus write starts and is done.
+// The stage latencies feed rolling windows of the last LATENCY_WINDOW
+// commands, reported by a "diagnostics" receiveSingle, or periodically by
+// receiveContinuous or by subscribing to the diagnostics characteristic.
+//
+// Commands carrying a sequence id ("seq" in JSON, FRAME_FLAG_SEQ in binary
+// frames) are also acknowledged on ACK_CHAR_UUID. Acks are batched, a batch
+// goes out when ACK_BATCH_SIZE records are waiting or the oldest is
+// ACK_BATCH_MS old.
+//
+//   [0]  ACK_MAGIC
+//   [1]  record count
+// followed by one 19 byte record per command, little endian:
+//   u16 seq, u32 received at, u32 dequeued, u32 bus start, u32 bus done,
+//   u8 flags
+// where the three times are microseconds after the receive timestamp.
+//
+// Coalesced actuator commands are all acked. The newest id carries the
+// write; every id merged over before that write is acked right ahead of
+// it with ACK_FLAG_SUPERSEDED and the same dequeue and bus times, as its
+// targets went out in that write unless a newer field replaced them. Ids
+// beyond ACK_SUPERSEDED_MAX per write are not acked, they are counted in
+// the "supersededUnacked" diagnostics counter.
+
+#define ACK_MAGIC 0xA1
+#define ACK_RECORD_SIZE 19
+#define ACK_FLAG_SUPERSEDED 0x01
+
+struct CommandTrace
+{
+  uint16_t seq;
+  bool sequenced;
+  uint32_t receivedAt;
+  uint32_t dequeuedAt;
+  uint32_t busStartAt;
+  uint32_t busDoneAt;
+  uint8_t superseded; // ids merged over before this write, oldest first
+  uint16_t supersededSeq[ACK_SUPERSEDED_MAX];
+  uint32_t supersededReceivedAt[ACK_SUPERSEDED_MAX];
+};
+
+// Record an executed command, queues an ack if it was sequenced
+void recordCommandTrace(const CommandTrace &trace);
+
+// Ticks until the pending ack batch is due, portMAX_DELAY if none
+TickType_t commandAckWait();
+
+// Send the pending ack batch if it is due (or always when forced)
+void flushCommandAcks(bool force);
+
+// Latency windows and control queue counters
+bool readDiagnosticsData(JsonObject &diagnostics);
+
+#endif // COMMAND_TRACE_H
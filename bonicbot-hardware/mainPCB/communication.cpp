@@ -4,23 +4,9 @@
 Ticker ledOnTicker;
 Ticker ledOffTicker;
 
-// Data sending interval tickers
-Ticker batterySendTicker;
-Ticker leftHandServosSendTicker;
-Ticker rightHandServosSendTicker;
-Ticker headServosSendTicker;
-Ticker baseSendTicker;
-Ticker distanceSendTicker;
-Ticker servoSendTicker;
-
-// Continuous data flags
-bool isContinuousBatteryActive = false;
-bool isContinuousLeftHandServosActive = false;
-bool isContinuousRightHandServosActive = false;
-bool isContinuousHeadServosActive = false;
-bool isContinuousBaseActive = false;
-bool isContinuousDistanceActive = false;
-bool isContinousServoActive = false;
+// Telemetry encoding of the current connection
+volatile Encoding connectionEncoding = ENCODING_JSON;
+volatile uint16_t connectionMtu = BLE_DEFAULT_MTU;
 
 // Global BLE objects
 BLEServer *pServer = nullptr;
@@ -34,6 +20,11 @@ BLECharacteristic *headServosChar = nullptr;
 BLECharacteristic *distanceChar = nullptr;
 BLECharacteristic *baseChar = nullptr;
 BLECharacteristic *servoChar = nullptr;
+BLECharacteristic *ackChar = nullptr;
+BLECharacteristic *diagnosticsChar = nullptr;
+BLECharacteristic *stateChar = nullptr;
+BLECharacteristic *historyChar = nullptr;
+BLECharacteristic *fastChar = nullptr;
 
 // ======================================================================
 // BLE Server Callbacks (for connection events)
@@ -42,24 +33,39 @@ class MyServerCallbacks : public BLEServerCallbacks
 {
   void onConnect(BLEServer *pServer) override
   {
-    Serial.println("Central connected");
+    LOG_INFO(CENTRAL_CONNECTED);
     deviceConnected = true;
     oldDeviceConnected = false; // Force welcome message
+    connectionEncoding = ENCODING_JSON; // until the client says hello
+    connectionMtu = BLE_DEFAULT_MTU;    // until the central exchanges MTU
+    resetNotifySender();
     stopBlinking();
     digitalWrite(LED_PIN, HIGH);
-    sendDataBasedOnDataType(BATTERY, 3000);
+    // Streams start as the client subscribes to their characteristics
   }
 
   void onDisconnect(BLEServer *pServer) override
   {
-    Serial.println("Central disconnected");
+    LOG_INFO(CENTRAL_DISCONNECTED);
     deviceConnected = false;
     oldDeviceConnected = true; // Force reconnection handling in loop
+    connectionEncoding = ENCODING_JSON;
+    connectionMtu = BLE_DEFAULT_MTU;
+    resetNotifySender();
     // Stop all continuous data sending on disconnection
+    clearChannelSubscriptions();
     stopAllContinuousDataSending();
     pServer->getAdvertising()->start();
     startDisconnectionBlinking();
   }
+
+  // The peripheral can't start the exchange on Bluedroid, it answers the
+  // central's request with up to BLE_PREFERRED_MTU
+  void onMtuChanged(BLEServer *pServer, esp_ble_gatts_cb_param_t *param) override
+  {
+    connectionMtu = param->mtu.mtu;
+    LOG_DEBUG(MTU_CHANGED, connectionMtu);
+  }
 };
 
 // ======================================================================
@@ -69,11 +75,12 @@ class ControlCallbacks : public BLECharacteristicCallbacks
 {
   void onWrite(BLECharacteristic *pCharacteristic) override
   {
-    // Convert the incoming value to an Arduino String.
-    String rxValue = pCharacteristic->getValue();
-    if (rxValue.length() > 0)
+    // Parse straight from the characteristic buffer
+    uint8_t *data = pCharacteristic->getData();
+    size_t len = pCharacteristic->getLength();
+    if (len > 0)
     {
-      processCommand(rxValue);
+      processCommand(data, len);
     }
   }
 };
@@ -99,6 +106,8 @@ void initializeBLE()
 {
   // Initialize BLE
   BLEDevice::init(BONICBOT_CODE);
+  BLEDevice::setMTU(BLE_PREFERRED_MTU);
+  BLEDevice::setCustomGattsHandler(notifyGattsEvent);
   pServer = BLEDevice::createServer();
   pServer->setCallbacks(new MyServerCallbacks());
 
@@ -108,55 +117,99 @@ void initializeBLE()
       COMMAND_CHAR_UUID,
       BLECharacteristic::PROPERTY_WRITE);
   commandChar->setCallbacks(new ControlCallbacks());
+
+  // Batched acknowledgements of sequenced commands
+  ackChar = controlService->createCharacteristic(
+      ACK_CHAR_UUID,
+      BLECharacteristic::PROPERTY_NOTIFY);
+  ackChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_ACK, ackChar);
   controlService->start();
 
   // ----- Feedback Service -----
-  feedbackService = pServer->createService(FEEDBACK_SERVICE_UUID);
+  // Each notify characteristic takes three handles, the default of 15
+  // only fits four
+  feedbackService = pServer->createService(BLEUUID(FEEDBACK_SERVICE_UUID), BLE_SERVICE_HANDLES);
 
   // Battery characteristic
   batteryChar = feedbackService->createCharacteristic(
       BATTERY_CHAR_UUID,
       BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ);
   batteryChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_BATTERY, batteryChar);
 
   // Distance sensor characteristic
   distanceChar = feedbackService->createCharacteristic(
       DISTANCE_FEEDBACK_CHAR_UUID,
       BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ);
   distanceChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_DISTANCE, distanceChar);
 
   baseChar = feedbackService->createCharacteristic(
       BASE_FEEDBACK_CHAR_UUID,
       BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ);
   baseChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_BASE, baseChar);
+
+  // Latency and queue diagnostics characteristic
+  diagnosticsChar = feedbackService->createCharacteristic(
+      DIAGNOSTICS_CHAR_UUID,
+      BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ);
+  diagnosticsChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_DIAGNOSTICS, diagnosticsChar);
+
+  // Aggregated state, every feedback reading in one fragmented message
+  stateChar = feedbackService->createCharacteristic(
+      STATE_CHAR_UUID,
+      BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ);
+  stateChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_STATE, stateChar);
+
+  // Telemetry history downloads
+  historyChar = feedbackService->createCharacteristic(
+      HISTORY_CHAR_UUID,
+      BLECharacteristic::PROPERTY_NOTIFY);
+  historyChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_HISTORY, historyChar);
 
   feedbackService->start();
 
   // -----Servos Feedback Service -----
-  servosFeedbackService = pServer->createService(SERVOS_FEEDBACK_SERVICE_UUID);
+  servosFeedbackService = pServer->createService(BLEUUID(SERVOS_FEEDBACK_SERVICE_UUID), BLE_SERVICE_HANDLES);
 
   // Left hand servos characteristic
   leftHandServosChar = servosFeedbackService->createCharacteristic(
       LEFT_HAND_SERVOS_FEEDBACK_CHAR_UUID,
       BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ);
   leftHandServosChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_LEFT_HAND, leftHandServosChar);
 
   // Right hand servos characteristic
   rightHandServosChar = servosFeedbackService->createCharacteristic(
       RIGHT_HAND_SERVOS_FEEDBACK_CHAR_UUID,
       BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ);
   rightHandServosChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_RIGHT_HAND, rightHandServosChar);
 
   // Head servos characteristic
   headServosChar = servosFeedbackService->createCharacteristic(
       HEAD_HAND_SERVOS_FEEDBACK_CHAR_UUID,
       BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ);
   headServosChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_HEAD, headServosChar);
 
   servoChar = servosFeedbackService->createCharacteristic(
       SERVO_FEEDBACK_CHAR_UUID,
       BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ);
   servoChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_SERVO, servoChar);
+
+  // High-rate servo frames
+  fastChar = servosFeedbackService->createCharacteristic(
+      FAST_FEEDBACK_CHAR_UUID,
+      BLECharacteristic::PROPERTY_NOTIFY);
+  fastChar->addDescriptor(new BLE2902());
+  bindChannelCharacteristic(LINK_CHANNEL_FAST, fastChar);
 
   servosFeedbackService->start();
 
@@ -171,16 +224,26 @@ void initializeBLE()
   pAdvertising->addServiceUUID(OTA_SERVICE_UUID);
   pAdvertising->start();
 
-  if (DEBUG)
-    Serial.println("BLE services started and advertising");
+  LOG_INFO(BLE_READY);
 }
 
 // Initialize communication systems based on configuration
 void initializeCommunication()
 {
   // Always initialize Serial for debugging
+#if COMM_METHOD == COMM_METHOD_SERIAL || COMM_METHOD == COMM_METHOD_BOTH
+  Serial.setRxBufferSize(USB_LINK_RX_BUFFER);
+#endif
   Serial.begin(MAIN_SERIAL_BAUD);
 
+  // Log records are framed on Serial in every mode
+  initializeUsbLink();
+  initializeLog();
+
+  initializeCommandParser();
+  initializeStatusDocument();
+  initializeTelemetryChannels();
+
 #if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
   // Initialize BLE services
   initializeBLE();
@@ -189,24 +252,6 @@ void initializeCommunication()
   // setupCoreDataTask();
 #endif
 
-#if COMM_METHOD == COMM_METHOD_SERIAL || COMM_METHOD == COMM_METHOD_BOTH
-  // Serial is already initialized in setup() for debug messages
-  if (DEBUG)
-    Serial.println("Serial communication ready");
-#endif
-
-  // Set initial values on all BLE characteristics if using BLE
-#if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
-  DynamicJsonDocument initialDoc(128);
-  initialDoc["status"] = "ready";
-  initialDoc["version"] = "2.0";
-  initialDoc["mode"] = "on-demand";
-
-  String initialJson;
-  serializeJson(initialDoc, initialJson);
-
-#endif
-
   // Start the disconnection blinking for BLE
   startDisconnectionBlinking();
 }
\ No newline at end of file
@@ -13,31 +13,27 @@
 #include "motor_control.h"
 #include "sensors.h"
 #include "ota_service.h"
+#include "command_frame.h"
+#include "protocol.h"
+#include "usb_link.h"
+#include "telemetry.h"
+#include "notify_sender.h"
+#include "telemetry_channel.h"
+#include "debug_log.h"
 
 // UUID for core data characteristic
 // #define CORE_DATA_CHAR_UUID "7bdc81d4-42ce-4934-a2ef-dec40bafb3b2"
 
-// Data sending interval timers
-extern Ticker batterySendTicker;
-extern Ticker leftHandServosSendTicker;
-extern Ticker rightHandServosSendTicker;
-extern Ticker headServosSendTicker;
-extern Ticker baseSendTicker;
-extern Ticker distanceSendTicker;
-extern Ticker servoSendTicker;
-
 // Connection status flags
 extern bool deviceConnected;
 extern bool oldDeviceConnected;
 
-// Continuous data flags
-extern bool isContinuousBatteryActive;
-extern bool isContinuousLeftHandServosActive;
-extern bool isContinuousRightHandServosActive;
-extern bool isContinuousHeadServosActive;
-extern bool isContinuousBaseActive;
-extern bool isContinuousDistanceActive;
-extern bool isContinousServoActive;
+// Telemetry encoding of the current connection, JSON until a hello
+extern volatile Encoding connectionEncoding;
+
+// ATT MTU of the current connection, BLE_DEFAULT_MTU until the central
+// exchanges a larger one
+extern volatile uint16_t connectionMtu;
 
 // External references to BLE objects
 extern BLEServer *pServer;
@@ -51,6 +47,11 @@ extern BLECharacteristic *headServosChar;
 extern BLECharacteristic *distanceChar;
 extern BLECharacteristic *baseChar;
 extern BLECharacteristic *servoChar;
+extern BLECharacteristic *ackChar;
+extern BLECharacteristic *diagnosticsChar;
+extern BLECharacteristic *stateChar;
+extern BLECharacteristic *historyChar;
+extern BLECharacteristic *fastChar;
 
 // Top-level initialization functions (in communication.cpp)
 void initializeCommunication();
@@ -60,14 +61,44 @@ void startDisconnectionBlinking();
 void stopBlinking();
 
 // Command processing functions (in communication_receive.cpp)
-void processCommand(String command);
+void initializeCommandParser();
+void processCommand(const uint8_t *data, size_t len);
+void processCommandFrame(const uint8_t *data, size_t len, uint32_t receivedAt);
+void processHello(const char *encoding);
+void processSubscription(DataType dataType, int intervalMs, bool enabled);
+uint32_t getCommandArenaMisses();
 
 // Data sending functions (in communication_send.cpp)
-void sendResponse(const String &response, const char *characteristicUUID = nullptr);
+void sendResponse(const uint8_t *data, size_t len, LinkChannel channel = LINK_CHANNEL_BATTERY);
+
+// Small documents from any task (hello, command replies), serialized on the stack
+void sendDocument(JsonDocument &doc, LinkChannel channel = LINK_CHANNEL_BATTERY);
+
+// Status replies from any task share one arena-backed document. Begin
+// locks and clears it and sets "status"; send adds "timestamp", sends it
+// and unlocks, so nothing may run between the two that sends another.
+void initializeStatusDocument();
+JsonDocument &beginStatusDocument(const char *status);
+void sendStatusDocument(LinkChannel channel = LINK_CHANNEL_BATTERY);
+uint32_t getStatusArenaMisses();
+
+// Telemetry task only, serialized into the channel's output buffer
+void sendChannelDocument(JsonDocument &doc, LinkChannel channel, bool fragmented = false);
+
+// Messages larger than one notification (the aggregated state) are split
+// into fragments, each with a reassembly header:
+//   [0] message sequence, the same for every fragment of a message
+//   [1] fragment index
+//   [2] fragment count
+// followed by the next slice of the message. BLE fragments fill the
+// negotiated MTU, USB link fragments fill USB_LINK_MAX_PACKET. A message
+// that fits is still sent as a single fragment with the header.
+#define FRAGMENT_HEADER_SIZE 3
+void sendFragmented(const uint8_t *data, size_t len, LinkChannel channel);
 void sendStatus(const char *statusMsg);
-void sendDataBasedOnDataType(const String &dataType, const int intervalMs = 0, const String servoName = "");
-void stopContinuousDataSending(const String &dataType);
+void sendDataBasedOnDataType(DataType dataType, const int intervalMs = 0, int servoIndex = -1,
+                             const TelemetryOptions *options = nullptr);
+void stopContinuousDataSending(DataType dataType);
 void stopAllContinuousDataSending();
-void processServoCommandsOfGroup(JsonObject servos, String group);
 
 #endif // COMMUNICATION_H
\ No newline at end of file
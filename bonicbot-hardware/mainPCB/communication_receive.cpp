@@ -1,86 +1,270 @@
 #include "communication.h"
+#include "json_arena.h"
+#include "control_task.h"
+#include "command_schedule.h"
+
+// Preallocated storage for the command document, reused for every command
+static uint8_t commandArenaBuffer[4096];
+static JsonArena commandArena(commandArenaBuffer, sizeof(commandArenaBuffer));
+static JsonDocument commandDoc(&commandArena);
+
+// BLE and the USB link can deliver commands from different tasks
+static SemaphoreHandle_t commandLock = nullptr;
+
+void initializeCommandParser()
+{
+    commandLock = xSemaphoreCreateMutex();
+}
+
+// Allocations that missed the command arena and went to the heap. Only
+// counts the command document, other documents are not included.
+uint32_t getCommandArenaMisses()
+{
+    return commandArena.heapAllocs;
+}
+
+static void parseCommand(const uint8_t *data, size_t len);
+
+// Process incoming command, one at a time
+void processCommand(const uint8_t *data, size_t len)
+{
+    xSemaphoreTake(commandLock, portMAX_DELAY);
+    parseCommand(data, len);
+    xSemaphoreGive(commandLock);
+}
 
 // Process incoming command - Command Parser
-void processCommand(String command)
+static void parseCommand(const uint8_t *data, size_t len)
 {
-    if (DEBUG)
+    uint32_t receivedAt = micros();
+
+    if (isCommandFrame(data, len))
     {
-        Serial.print("Received command: ");
-        Serial.println(command);
+        processCommandFrame(data, len, receivedAt);
+        return;
     }
 
-    // Create a JSON document for parsing
-    DynamicJsonDocument doc(1024);
-    DeserializationError error = deserializeJson(doc, command);
+    bool msgPack = isMsgPackMap(data, len);
+
+    if (msgPack)
+        LOG_DEBUG(COMMAND_MSGPACK, len);
+    else
+        LOG_DEBUG(COMMAND_JSON, len);
+
+    // Reuse the preallocated document
+    commandDoc.clear();
+    commandArena.reset();
+    DeserializationError error = msgPack ? deserializeMsgPack(commandDoc, data, len)
+                                         : deserializeJson(commandDoc, (const char *)data, len);
     if (error)
     {
-        if (DEBUG)
-        {
-            Serial.print("JSON parse error: ");
-            Serial.println(error.c_str());
-        }
+        LOG_WARN(JSON_PARSE_ERROR, error.c_str());
+        return;
+    }
+
+    // Encoding negotiation, answered directly
+    if (parseCommandType(commandDoc["commandType"]) == COMMAND_HELLO)
+    {
+        processHello(commandDoc["encoding"]);
         return;
     }
 
     // Process data request command
-    if (doc.containsKey("dataType") && doc.containsKey("commandType") && doc.containsKey("payload") && doc.containsKey("interval"))
+    JsonVariant dataTypeToken = commandDoc["dataType"];
+    JsonVariant commandTypeToken = commandDoc["commandType"];
+    JsonVariant payloadValue = commandDoc["payload"];
+    JsonVariant intervalValue = commandDoc["interval"];
+    if (!dataTypeToken.isNull() && !commandTypeToken.isNull() && !payloadValue.isNull() && !intervalValue.isNull())
     {
-        String dataType = doc["dataType"].as<String>();
-        String commandType = doc["commandType"].as<String>();
-        JsonObject payload = doc["payload"].as<JsonObject>();
-        int interval = doc["interval"].as<int>();
+        DataType dataType = parseDataType(dataTypeToken);
+        CommandType commandType = parseCommandType(commandTypeToken);
+        JsonObject payload = payloadValue.as<JsonObject>();
+        int interval = intervalValue.as<int>();
+        ControlCommand command;
+        command.receivedAt = receivedAt;
+        command.sequenced = commandDoc["seq"].is<uint16_t>();
+        command.seq = commandDoc["seq"] | 0;
+        command.scheduled = commandDoc["at"].is<uint32_t>();
+        command.executeAt = commandDoc["at"] | 0u;
 
-        if (commandType == "command")
+        if (commandType == COMMAND_COMMAND)
         {
-            if (dataType == LEFT_HAND_GROUP || dataType == RIGHT_HAND_GROUP || dataType == HEAD_GROUP)
+            if (isServoGroup(dataType))
             {
-                if (dataType == HEAD_GROUP && payload.containsKey("mode"))
+                JsonVariant mode = payload["mode"];
+                if (dataType == DATA_HEAD && !mode.isNull())
                 {
-                    String modeStr = payload["mode"].as<String>();
-                    setHeadMode(modeStr);
+                    command.kind = CONTROL_HEAD_MODE;
+                    strlcpy(command.headMode, mode | "", sizeof(command.headMode));
+                    submitControlCommand(command);
                 }
 
-                processServoCommandsOfGroup(payload, dataType);
-            }
-            else if (dataType == BASE)
-            {
-                processMotorCommands(payload);
-            }
-            else if (dataType == SERVO)
-            {
-                // the payload must contain the servoname
-                processServoCommandOfSingle(payload);
+                command.kind = CONTROL_SERVOS;
+                if (parseServoCommandsOfGroup(payload, dataType, command.servos))
+                {
+                    submitControlCommand(command);
+                }
             }
-        }
-        else if (commandType == "receiveSingle")
-        {
-            if (payload.containsKey("id"))
+            else if (dataType == DATA_BASE)
             {
-                sendDataBasedOnDataType(dataType, 0, payload["id"]);
+                int leftSpeed, rightSpeed;
+                parseMotorCommands(payload, leftSpeed, rightSpeed);
+                command.kind = CONTROL_BASE;
+                command.base.left = leftSpeed;
+                command.base.right = rightSpeed;
+                submitControlCommand(command);
             }
-            else
+            else if (dataType == DATA_BODY)
             {
-                sendDataBasedOnDataType(dataType);
-            }
-        }
-        else if (commandType == "receiveContinuous")
-        {
-            if (payload.containsKey("id"))
-            {
-                sendDataBasedOnDataType(dataType, interval, payload["id"]);
+                // servo names as keys, plus an optional base object
+                command.kind = CONTROL_BODY;
+                bool hasServos = parseServoCommandsOfBody(payload, command.body.servos);
+                JsonVariant base = payload[BASE];
+                command.body.hasBase = !base.isNull();
+                if (command.body.hasBase)
+                {
+                    int leftSpeed, rightSpeed;
+                    parseMotorCommands(base, leftSpeed, rightSpeed);
+                    command.body.left = leftSpeed;
+                    command.body.right = rightSpeed;
+                }
+                if (hasServos || command.body.hasBase)
+                {
+                    submitControlCommand(command);
+                }
             }
-            else
+            else if (dataType == DATA_SERVO)
             {
-                sendDataBasedOnDataType(dataType, interval);
+                // the payload must contain the servoname
+                int servoIndex;
+                switch (parseServoCommandOfSingle(payload, command.servos, servoIndex))
+                {
+                case SINGLE_SERVO_MOVE:
+                    command.kind = CONTROL_SERVOS;
+                    submitControlCommand(command);
+                    break;
+                case SINGLE_SERVO_MIDDLE:
+                    command.kind = CONTROL_SERVO_MIDDLE;
+                    command.servoIndex = servoIndex;
+                    submitControlCommand(command);
+                    break;
+                case SINGLE_SERVO_RELEASE:
+                    command.kind = CONTROL_SERVO_RELEASE;
+                    command.servoIndex = servoIndex;
+                    submitControlCommand(command);
+                    break;
+                default:
+                    break;
+                }
             }
         }
-        else if (commandType == "stopReceive")
+        else if (commandType != COMMAND_UNKNOWN)
         {
-            if (payload.containsKey("all"))
-            {
-                stopAllContinuousDataSending();
-            }
-            stopContinuousDataSending(dataType);
+            command.kind = CONTROL_TELEMETRY;
+            command.telemetry.dataType = dataType;
+            command.telemetry.commandType = commandType;
+            command.telemetry.interval = interval;
+            JsonVariant id = payload["id"];
+            command.telemetry.servoIndex = id.isNull() ? -1 : findServoByName(id);
+            command.telemetry.stopAll = !payload["all"].isNull();
+            command.telemetry.fromMs = payload["from"] | 0u;
+            command.telemetry.toMs = payload["to"] | (uint32_t)millis();
+            command.telemetry.servoMask = dataType == DATA_FAST ? parseServoMask(payload["servos"].as<JsonArrayConst>()) : 0;
+            TelemetryOptions &options = command.telemetry.options;
+            setDefaultTelemetryOptions(options);
+            options.format = parseTelemetryFormat(commandDoc["format"]);
+            options.delta = commandDoc["delta"] | false;
+            options.keyframeEvery = constrain(commandDoc["keyframe"] | TELEMETRY_KEYFRAME_EVERY, 1, 255);
+            parseDeadbands(commandDoc["deadband"].as<JsonObjectConst>(), options.deadbands);
+            submitControlCommand(command);
         }
     }
+}
+
+// Start or stop the default stream of a characteristic whose
+// notifications were switched on or off
+void processSubscription(DataType dataType, int intervalMs, bool enabled)
+{
+    ControlCommand command;
+    command.receivedAt = micros();
+    command.sequenced = false;
+    command.seq = 0;
+    command.scheduled = false;
+    command.executeAt = 0;
+    command.kind = CONTROL_TELEMETRY;
+    command.telemetry.dataType = dataType;
+    command.telemetry.commandType = enabled ? COMMAND_RECEIVE_CONTINUOUS : COMMAND_STOP_RECEIVE;
+    command.telemetry.interval = intervalMs;
+    command.telemetry.servoIndex = -1;
+    command.telemetry.stopAll = false;
+    command.telemetry.fromMs = 0;
+    command.telemetry.toMs = 0;
+    command.telemetry.servoMask = ALL_SERVOS_MASK;
+    setDefaultTelemetryOptions(command.telemetry.options);
+    submitControlCommand(command);
+}
+
+// Switch the telemetry encoding and acknowledge in the new encoding.
+// Called by the parser with the command lock held, encoding points into the
+// command document.
+void processHello(const char *encoding)
+{
+    Encoding selected = ENCODING_JSON;
+    if (encoding != nullptr && !parseEncoding(encoding, selected))
+    {
+        LOG_WARN(ENCODING_UNSUPPORTED, encoding);
+        selected = ENCODING_JSON;
+    }
+    connectionEncoding = selected;
+
+    // The command is done with, build the reply in its document
+    commandDoc.clear();
+    commandArena.reset();
+    commandDoc["status"] = "hello";
+    commandDoc["encoding"] = encodingName(selected);
+    commandDoc["firmware"] = FIRMWARE_VERSION;
+    commandDoc["deviceTimeUs"] = (uint32_t)micros(); // clock of "at" deadlines
+    sendDocument(commandDoc);
+
+    LOG_INFO(ENCODING_SET, encodingName(selected));
+}
+
+// Process incoming binary command frame
+void processCommandFrame(const uint8_t *data, size_t len, uint32_t receivedAt)
+{
+    CommandFrame frame;
+    if (!decodeCommandFrame(data, len, frame))
+    {
+        LOG_WARN(COMMAND_FRAME_INVALID);
+        return;
+    }
+
+    ControlCommand command;
+    command.receivedAt = receivedAt;
+    command.sequenced = frame.sequenced;
+    command.seq = frame.seq;
+    command.scheduled = frame.scheduled;
+    command.executeAt = frame.executeAt;
+    if (frame.opcode == FRAME_OP_SERVOS)
+    {
+        command.kind = CONTROL_SERVOS;
+        command.servos = frame.servos;
+        submitControlCommand(command);
+    }
+    else if (frame.opcode == FRAME_OP_BASE)
+    {
+        command.kind = CONTROL_BASE;
+        command.base.left = frame.leftSpeed;
+        command.base.right = frame.rightSpeed;
+        submitControlCommand(command);
+    }
+    else if (frame.opcode == FRAME_OP_BODY)
+    {
+        command.kind = CONTROL_BODY;
+        command.body.servos = frame.servos;
+        command.body.hasBase = frame.hasBase;
+        command.body.left = frame.leftSpeed;
+        command.body.right = frame.rightSpeed;
+        submitControlCommand(command);
+    }
 }
\ No newline at end of file
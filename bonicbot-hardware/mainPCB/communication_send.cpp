@@ -1,317 +1,258 @@
+#include <atomic>
 #include "communication.h"
+#include "json_arena.h"
+#include "fast_stream.h"
 
-// Send response over selected communication channels
-void sendResponse(const String &response, const char *characteristicUUID)
-{
+// Largest encoded document sent from outside the telemetry task
+#define DOCUMENT_BUFFER_SIZE 512
+
+// Arena for the status document; one ArduinoJson pool page plus strings
+#define STATUS_ARENA_SIZE 1280
 
+// Largest fragment on any channel, header included
+#define FRAGMENT_MAX_SIZE (USB_LINK_MAX_PACKET - 4)
+
+// Send a binary response over selected communication channels
+void sendResponse(const uint8_t *data, size_t len, LinkChannel channel)
+{
 #if COMM_METHOD == COMM_METHOD_SERIAL || COMM_METHOD == COMM_METHOD_BOTH
-    // Send over Serial
-    Serial.println(response);
+    usbLinkSend(LINK_TYPE_TELEMETRY, channel, data, len);
 #endif
 
 #if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
-    // Send over BLE if connected
-    if (DEBUG)
-    {
-        Serial.print("BLE send debug: deviceConnected=");
-        Serial.println(deviceConnected ? "true" : "false");
-        Serial.print("Characteristic UUID: ");
-        Serial.println(characteristicUUID ? characteristicUUID : "nullptr");
-        Serial.print("Response: ");
-        Serial.println(response);
-    }
+    LOG_DEBUG(BLE_SEND, len, channelName(channel), deviceConnected);
 
     if (deviceConnected)
     {
-        if (characteristicUUID == nullptr || strcmp(characteristicUUID, BATTERY_CHAR_UUID) == 0)
-        {
-            batteryChar->setValue(response.c_str());
-            batteryChar->notify();
-        }
-        else if (strcmp(characteristicUUID, LEFT_HAND_SERVOS_FEEDBACK_CHAR_UUID) == 0)
-        {
-            leftHandServosChar->setValue(response.c_str());
-            leftHandServosChar->notify();
-        }
-        else if (strcmp(characteristicUUID, RIGHT_HAND_SERVOS_FEEDBACK_CHAR_UUID) == 0)
-        {
-            rightHandServosChar->setValue(response.c_str());
-            rightHandServosChar->notify();
-        }
-        else if (strcmp(characteristicUUID, HEAD_HAND_SERVOS_FEEDBACK_CHAR_UUID) == 0)
-        {
-            headServosChar->setValue(response.c_str());
-            headServosChar->notify();
-        }
-        else if (strcmp(characteristicUUID, DISTANCE_FEEDBACK_CHAR_UUID) == 0)
-        {
-            distanceChar->setValue(response.c_str());
-            distanceChar->notify();
-        }
-        else if (strcmp(characteristicUUID, BASE_FEEDBACK_CHAR_UUID) == 0)
-        {
-            baseChar->setValue(response.c_str());
-            baseChar->notify();
-        }
-        else if (strcmp(characteristicUUID, SERVO_FEEDBACK_CHAR_UUID) == 0)
-        {
-            servoChar->setValue(response.c_str());
-            servoChar->notify();
-        }
+        BLECharacteristic *characteristic = channelCharacteristic(channel);
+        if (characteristic != nullptr)
+            notifySend(characteristic, data, len);
     }
 #endif
 }
 
-// Send a status update
-void sendStatus(const char *statusMsg)
+// Split a message into fragments of at most maxFragment bytes, header
+// included, and pass each to send
+static void sendFragmentsTo(void (*send)(const uint8_t *, size_t, LinkChannel),
+                            uint8_t seq, const uint8_t *data, size_t len,
+                            size_t maxFragment, LinkChannel channel)
 {
-    DynamicJsonDocument statusDoc(128);
-    statusDoc["status"] = statusMsg;
-    statusDoc["timestamp"] = millis();
-
-    String statusJson;
-    serializeJson(statusDoc, statusJson);
-
-    sendResponse(statusJson);
+    uint8_t fragment[FRAGMENT_MAX_SIZE];
+    size_t chunk = min(maxFragment, sizeof(fragment)) - FRAGMENT_HEADER_SIZE;
+    size_t count = max((size_t)1, (len + chunk - 1) / chunk);
+    if (count > 255)
+    {
+        LOG_ERROR(FRAGMENT_TOO_LARGE, len);
+        return;
+    }
 
-    if (DEBUG)
+    for (size_t i = 0; i < count; i++)
     {
-        Serial.print("Status sent: ");
-        Serial.println(statusMsg);
+        size_t offset = i * chunk;
+        size_t n = min(chunk, len - offset);
+        fragment[0] = seq;
+        fragment[1] = i;
+        fragment[2] = count;
+        memcpy(fragment + FRAGMENT_HEADER_SIZE, data + offset, n);
+        send(fragment, n + FRAGMENT_HEADER_SIZE, channel);
     }
 }
 
-// Stop continuous data sending
-void stopContinuousDataSending(const String &dataType)
+#if COMM_METHOD == COMM_METHOD_SERIAL || COMM_METHOD == COMM_METHOD_BOTH
+static void sendUsbFragment(const uint8_t *data, size_t len, LinkChannel channel)
 {
+    usbLinkSend(LINK_TYPE_TELEMETRY, channel, data, len);
+}
+#endif
+
 #if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
-    if (dataType == BATTERY)
-    {
-        batterySendTicker.detach();
-        isContinuousBatteryActive = false;
-        if (DEBUG)
-            Serial.println("Stopped continuous battery data sending");
-    }
-    else if (dataType == LEFT_HAND_GROUP)
+static void sendBleFragment(const uint8_t *data, size_t len, LinkChannel channel)
+{
+    BLECharacteristic *characteristic = channelCharacteristic(channel);
+    if (characteristic != nullptr)
+        notifySend(characteristic, data, len);
+}
+#endif
+
+// Message ids shared by every sender, so fragments of messages sent
+// from different tasks never reuse an id while both are in flight
+static std::atomic<uint8_t> messageSeq(0);
+
+// Send a message in fragments sized for each channel, from any task
+void sendFragmented(const uint8_t *data, size_t len, LinkChannel channel)
+{
+    uint8_t seq = messageSeq.fetch_add(1, std::memory_order_relaxed);
+
+#if COMM_METHOD == COMM_METHOD_SERIAL || COMM_METHOD == COMM_METHOD_BOTH
+    sendFragmentsTo(sendUsbFragment, seq, data, len, USB_LINK_MAX_PACKET - 4, channel);
+#endif
+
+#if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
+    if (deviceConnected)
+        sendFragmentsTo(sendBleFragment, seq, data, len, connectionMtu - 3, channel);
+#endif
+}
+
+// Serialize in the negotiated encoding, 0 if the buffer is too small
+static size_t serializeDocument(JsonDocument &doc, uint8_t *buffer, size_t capacity)
+{
+    if (connectionEncoding == ENCODING_MSGPACK)
     {
-        leftHandServosSendTicker.detach();
-        isContinuousLeftHandServosActive = false;
-        if (DEBUG)
-            Serial.println("Stopped continuous left hand servo data sending");
+        if (measureMsgPack(doc) > capacity)
+            return 0;
+        return serializeMsgPack(doc, buffer, capacity);
     }
-    else if (dataType == RIGHT_HAND_GROUP)
+
+    // serializeJson also writes a terminator
+    if (measureJson(doc) >= capacity)
+        return 0;
+    return serializeJson(doc, buffer, capacity);
+}
+
+// Send a small document in the negotiated encoding, from any task
+void sendDocument(JsonDocument &doc, LinkChannel channel)
+{
+    uint8_t buffer[DOCUMENT_BUFFER_SIZE];
+    size_t len = serializeDocument(doc, buffer, sizeof(buffer));
+    if (len == 0)
     {
-        rightHandServosSendTicker.detach();
-        isContinuousRightHandServosActive = false;
-        if (DEBUG)
-            Serial.println("Stopped continuous right hand servo data sending");
+        LOG_ERROR(DOCUMENT_TOO_LARGE);
+        return;
     }
-    else if (dataType == HEAD_GROUP)
+    sendResponse(buffer, len, channel);
+}
+
+// Send a telemetry document through the channel's output buffer
+void sendChannelDocument(JsonDocument &doc, LinkChannel channel, bool fragmented)
+{
+    size_t capacity;
+    uint8_t *output = channelOutput(channel, capacity);
+    size_t len = serializeDocument(doc, output, capacity);
+    if (len == 0)
     {
-        headServosSendTicker.detach();
-        isContinuousHeadServosActive = false;
-        if (DEBUG)
-            Serial.println("Stopped continuous head servo data sending");
+        LOG_ERROR(TELEMETRY_TOO_LARGE, channelName(channel));
+        return;
     }
-    else if (dataType == BASE)
+
+    if (fragmented)
+        sendFragmented(output, len, channel);
+    else
+        sendResponse(output, len, channel);
+}
+
+// Preallocated storage for status replies, reused for every reply
+static uint8_t statusArenaBuffer[STATUS_ARENA_SIZE];
+static JsonArena statusArena(statusArenaBuffer, sizeof(statusArenaBuffer));
+static JsonDocument statusDoc(&statusArena);
+static SemaphoreHandle_t statusLock = nullptr;
+
+void initializeStatusDocument()
+{
+    statusLock = xSemaphoreCreateMutex();
+}
+
+JsonDocument &beginStatusDocument(const char *status)
+{
+    xSemaphoreTake(statusLock, portMAX_DELAY);
+    statusDoc.clear();
+    statusArena.reset();
+    statusDoc["status"] = status;
+    return statusDoc;
+}
+
+// Serialize under the lock but send after releasing it, so a slow link
+// never holds up another task's status reply
+void sendStatusDocument(LinkChannel channel)
+{
+    statusDoc["timestamp"] = millis();
+
+    uint8_t buffer[DOCUMENT_BUFFER_SIZE];
+    size_t len = serializeDocument(statusDoc, buffer, sizeof(buffer));
+    xSemaphoreGive(statusLock);
+
+    if (len == 0)
     {
-        baseSendTicker.detach();
-        isContinuousBaseActive = false;
-        if (DEBUG)
-            Serial.println("Stopped continuous base/motor data sending");
+        LOG_ERROR(DOCUMENT_TOO_LARGE);
+        return;
     }
-    else if (dataType == DISTANCE)
+    sendResponse(buffer, len, channel);
+}
+
+// Allocations that missed the status arena and went to the heap
+uint32_t getStatusArenaMisses()
+{
+    return statusArena.heapAllocs;
+}
+
+// Send a status update
+void sendStatus(const char *statusMsg)
+{
+    beginStatusDocument(statusMsg);
+    sendStatusDocument();
+
+    LOG_INFO(STATUS_SENT, statusMsg);
+}
+
+// Stop continuous data sending
+void stopContinuousDataSending(DataType dataType)
+{
+    if (dataType == DATA_FAST)
     {
-        distanceSendTicker.detach();
-        isContinuousDistanceActive = false;
-        if (DEBUG)
-            Serial.println("Stopped continuous distance data sending");
+        stopFastStream();
+        return;
     }
-#endif
+
+    TelemetryStream stream = telemetryStreamFor(dataType);
+    if (stream == STREAM_COUNT)
+        return;
+
+    stopTelemetryStream(stream);
+    LOG_DEBUG(STREAM_STOPPED, dataTypeName(dataType));
 }
 
 // Stop all continuous data sending
 void stopAllContinuousDataSending()
 {
-#if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
-    batterySendTicker.detach();
-    leftHandServosSendTicker.detach();
-    rightHandServosSendTicker.detach();
-    headServosSendTicker.detach();
-    baseSendTicker.detach();
-    distanceSendTicker.detach();
-    servoSendTicker.detach();
-
-    isContinuousBatteryActive = false;
-    isContinuousLeftHandServosActive = false;
-    isContinuousRightHandServosActive = false;
-    isContinuousHeadServosActive = false;
-    isContinuousBaseActive = false;
-    isContinuousDistanceActive = false;
-    isContinousServoActive = false;
-
-    if (DEBUG)
-        Serial.println("Stopped all continuous data sending");
-#endif
+    stopAllTelemetryStreams();
+    stopFastStream();
+
+    LOG_DEBUG(STREAMS_STOPPED);
 }
 
-void sendDataBasedOnDataType(const String &dataType, int intervalMs, const String servoName)
+// Start a stream, or request one read when intervalMs is 0. Runs on the
+// control task; the reads themselves run on the telemetry task.
+void sendDataBasedOnDataType(DataType dataType, int intervalMs, int servoIndex, const TelemetryOptions *options)
 {
-#if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
+#if COMM_METHOD == COMM_METHOD_BLE
     if (!deviceConnected)
     {
-        if (DEBUG)
-            Serial.println("Cannot start data sending: device not connected");
+        LOG_WARN(STREAM_NOT_CONNECTED);
         return;
     }
+#endif
 
     bool isSendOnce = (intervalMs == 0);
 
     // Ensure the interval is reasonable (not too fast) if we're doing continuous sending
-    if (!isSendOnce && intervalMs < 100)
+    if (!isSendOnce && dataType == DATA_HISTORY)
+        intervalMs = max(intervalMs, HISTORY_MIN_INTERVAL_MS);
+    else if (!isSendOnce && intervalMs < 100)
         intervalMs = 100;
 
-    // Function pointers and settings for each data type
-    typedef bool (*DataReaderFunc)(JsonObject &);
-    DataReaderFunc dataReader = nullptr;
-    const char *charUUID = nullptr;
-    bool *continuousActiveFlag = nullptr;
-    Ticker *dataSendTicker = nullptr;
-    int jsonSize = 0;
-    String typeName = "";
-
-    // Configure based on data type
-    if (dataType == BATTERY)
-    {
-        dataReader = readBmsData;
-        charUUID = BATTERY_CHAR_UUID;
-        continuousActiveFlag = &isContinuousBatteryActive;
-        dataSendTicker = &batterySendTicker;
-        jsonSize = 256;
-        typeName = "battery";
-    }
-    else if (dataType == LEFT_HAND_GROUP)
-    {
-        dataReader = readLeftHandServoData;
-        charUUID = LEFT_HAND_SERVOS_FEEDBACK_CHAR_UUID;
-        continuousActiveFlag = &isContinuousLeftHandServosActive;
-        dataSendTicker = &leftHandServosSendTicker;
-        jsonSize = 1024;
-        typeName = "left hand servos";
-    }
-    else if (dataType == RIGHT_HAND_GROUP)
-    {
-        dataReader = readRightHandServoData;
-        charUUID = RIGHT_HAND_SERVOS_FEEDBACK_CHAR_UUID;
-        continuousActiveFlag = &isContinuousRightHandServosActive;
-        dataSendTicker = &rightHandServosSendTicker;
-        jsonSize = 1024;
-        typeName = "right hand servos";
-    }
-    else if (dataType == HEAD_GROUP)
-    {
-        dataReader = readHeadServoData;
-        charUUID = HEAD_HAND_SERVOS_FEEDBACK_CHAR_UUID;
-        continuousActiveFlag = &isContinuousHeadServosActive;
-        dataSendTicker = &headServosSendTicker;
-        jsonSize = 512;
-        typeName = "head servos";
-    }
-    else if (dataType == BASE)
-    {
-        dataReader = readBaseMotorData;
-        charUUID = BASE_FEEDBACK_CHAR_UUID;
-        continuousActiveFlag = &isContinuousBaseActive;
-        dataSendTicker = &baseSendTicker;
-        jsonSize = 256;
-        typeName = "base";
-    }
-    else if (dataType == DISTANCE)
-    {
-        dataReader = readDistanceData;
-        charUUID = DISTANCE_FEEDBACK_CHAR_UUID;
-        continuousActiveFlag = &isContinuousDistanceActive;
-        dataSendTicker = &distanceSendTicker;
-        jsonSize = 512;
-        typeName = "distance";
-    }
-    else if (dataType == SERVO)
-    {
-        dataReader = readSingleServoData;
-        charUUID = SERVO_FEEDBACK_CHAR_UUID;
-        continuousActiveFlag = &isContinousServoActive;
-        dataSendTicker = &servoSendTicker;
-        jsonSize = 512;
-        typeName = servoName;
-    }
-    else
-    {
-        if (DEBUG)
-            Serial.println("Unknown data type requested");
-        return;
-    }
-
-    // Create local copies for the lambda capture
-    DataReaderFunc readerFunc = dataReader;
-    const char *uuid = charUUID;
-    int docSize = jsonSize;
-    String name = typeName;
-    // String sName = servoName;
+    TelemetryStream stream = telemetryStreamFor(dataType);
+    if (stream == STREAM_SERVO && servoIndex < 0)
+        stream = STREAM_COUNT;
 
-    // Handle one-time sending
-    if (isSendOnce)
+    TelemetryFormat format = options != nullptr ? options->format : FORMAT_DOCUMENT;
+    bool started = stream != STREAM_COUNT &&
+                   (isSendOnce ? requestTelemetryOnce(stream, servoIndex, format)
+                               : startTelemetryStream(stream, intervalMs, servoIndex, options));
+    if (!started)
     {
-        DynamicJsonDocument doc(docSize);
-        JsonObject root = doc.to<JsonObject>();
-        // if (name == "servo")
-        root["type"] = name;
-        readerFunc(root);
-        root["timestamp"] = millis();
-        root["continuous"] = false;
-
-        String json;
-        serializeJson(doc, json);
-        sendResponse(json, uuid);
-
-        if (DEBUG)
-            Serial.println("One-time " + name + " data sent");
-    }
-    // Handle continuous sending
-    else
-    {
-        // Stop any existing timer first
-        if (*continuousActiveFlag)
-        {
-            dataSendTicker->detach();
-        }
-
-        // Set up new ticker for data
-        dataSendTicker->attach_ms(intervalMs, [readerFunc, uuid, docSize, name]()
-                                  {
-                DynamicJsonDocument doc(docSize);
-                JsonObject root = doc.to<JsonObject>();
-                // if (name == "servo")
-                root["id"] = name;
-                readerFunc(root);
-                root["timestamp"] = millis();
-                root["continuous"] = true;
-
-                String json;
-                serializeJson(doc, json);
-                sendResponse(json, uuid);
-
-                if (DEBUG)
-                    Serial.println("Continuous " + name + " data sent"); });
-
-        *continuousActiveFlag = true;
-
-        if (DEBUG)
-        {
-            Serial.print("Started continuous " + name + " data sending with interval: ");
-            Serial.print(intervalMs);
-            Serial.println("ms");
-        }
+        LOG_WARN(STREAM_UNKNOWN);
+        return;
     }
 
-#endif
-}
\ No newline at end of file
+    if (!isSendOnce)
+        LOG_DEBUG(STREAM_STARTED, dataTypeName(dataType), intervalMs);
+}
@@ -29,10 +29,91 @@
 // Serial baud rate for main communication (when using SERIAL or BOTH)
 #define MAIN_SERIAL_BAUD 115200
 
+// Framed USB link (when using SERIAL or BOTH), see usb_link.h
+#define USB_LINK_MAX_PACKET 1100 // decoded bytes, fits a 1024 byte document
+#define USB_LINK_RX_BUFFER 4096 // Serial RX buffer bytes
+
+// BLE ATT MTU offered to the central, notifications carry MTU - 3 bytes
+#define BLE_PREFERRED_MTU 517
+#define BLE_DEFAULT_MTU 23
+#define BLE_SERVICE_HANDLES 32 // GATT handles per feedback service
+
+// Notification sender, see notify_sender.h
+#define NOTIFY_MAX_CHARACTERISTICS 12 // tracked notify characteristics
+#define NOTIFY_INFLIGHT_TIMEOUT_MS 250 // in-flight notify counted as failed after this
+
+// Largest encoded message sent in fragments (the aggregated state and
+// diagnostics)
+#define FRAGMENTED_MESSAGE_MAX 4096
+
+// ======================================================================
+// Control task
+// ======================================================================
+#define CONTROL_QUEUE_LENGTH 16 // pending decoded commands
+#define CONTROL_TASK_STACK 4096 // bytes
+#define CONTROL_TASK_PRIORITY 3 // above loop(), below the BLE stack
+#define CONTROL_TASK_CORE 1 // Bluedroid runs on core 0
+
+// Telemetry task
+#define TELEMETRY_TASK_STACK 8192 // bytes
+#define TELEMETRY_TASK_PRIORITY 2 // below the control task
+#define TELEMETRY_TASK_CORE 1
+#define TELEMETRY_SPREAD_MS 10 // minimum offset between stream deadlines
+#define TELEMETRY_KEYFRAME_EVERY 20 // default delta keyframe period, in runs
+
+// Telemetry history ring, see telemetry_history.h
+#define HISTORY_SAMPLES 6000 // 60 s at 100 Hz, 384 KB in PSRAM
+#define HISTORY_FALLBACK_SAMPLES 500 // 32 KB of internal RAM without PSRAM
+#define HISTORY_MIN_INTERVAL_MS 10
+#define HISTORY_IO_TIMEOUT_US 300 // servo turnaround allowed per history read
+#define HISTORY_TASK_STACK 4096 // bytes
+#define HISTORY_TASK_PRIORITY 1 // downloads yield to telemetry and control
+#define HISTORY_TASK_CORE 1
+
+// High-rate servo stream, see fast_stream.h
+#define FAST_STREAM_MIN_INTERVAL_MS 5 // 200 Hz
+#define FAST_STREAM_MAX_INTERVAL_MS 100 // slower streams are served by the telemetry task
+#define FAST_STREAM_BUS_BUDGET 60 // percent of bus time the poller may take, less the servo write load
+#define FAST_STREAM_MIN_BUS_BUDGET 10 // percent left to the poller however busy the writes keep the bus
+#define FAST_STREAM_LOAD_WINDOW_MS 100 // servo write load is averaged over windows this long
+#define FAST_STREAM_IO_TIMEOUT_US 300 // servo turnaround allowed while streaming
+#define FAST_TASK_STACK 4096 // bytes
+#define FAST_TASK_PRIORITY 2 // with the telemetry task, below control
+#define FAST_TASK_CORE 1
+
+// Servo bus driver, see servo_bus.h
+#define SERVO_BUS_QUEUE_LENGTH 8 // submitted transactions
+#define SERVO_BUS_TASK_STACK 4096 // bytes
+#define SERVO_BUS_TASK_PRIORITY 4 // above control, takes a submit at once
+#define SERVO_BUS_TASK_CORE 1
+
+// Command acknowledgements and latency tracing
+#define ACK_BATCH_SIZE 8 // acks per notification
+#define ACK_BATCH_MS 50 // longest an ack waits for its batch
+#define ACK_SUPERSEDED_MAX 16 // superseded ids held until the next servo write
+#define LATENCY_WINDOW 128 // commands kept per latency window
+
+// Time-scheduled commands
+#define SCHEDULE_CAPACITY 32 // commands waiting for their deadline
+#define SCHEDULE_LATE_US 2000 // later than this is reported, not executed
+#define SCHEDULE_MAX_AHEAD_MS 60000 // furthest accepted deadline
+
 // ======================================================================
-// Debug mode
+// Debug logging, see debug_log.h
 // ======================================================================
-#define DEBUG true
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL LOG_LEVEL_DEBUG // records above this level are compiled out
+#define LOG_RING_SIZE 256 // queued records, power of two
+#define LOG_RATE_WINDOW_MS 1000
+#define LOG_RATE_BURST 20 // records per message and window, the rest are counted
+#define LOG_DRAIN_INTERVAL_MS 20
+#define LOG_TASK_STACK 3072 // bytes
+#define LOG_TASK_PRIORITY 1 // only above idle
+#define LOG_TASK_CORE 0 // away from the control and telemetry tasks
 #define RELAY_PIN 35
 
 // ======================================================================
@@ -53,6 +134,11 @@
 // Servo communication
 #define SERVOS_RXD 17 // RX for all servos
 #define SERVOS_TXD 18 // TX for all servos
+#define SERVOS_BAUD 1000000
+#define SERVO_REPLY_TIMEOUT_US 500 // servo turnaround, the reply's wire time is added
+#define SERVO_TIMEOUT_MIN_US 100 // floor of the per-servo timeouts, see servo_health.h
+#define SERVO_QUARANTINE_FAILURES 3 // missed replies in a row
+#define SERVO_QUARANTINE_PING_MS 1000 // ping period of a quarantined servo
 
 // BMS communication
 #define BMS_RXD 37 // BMS RX
@@ -74,12 +160,16 @@ typedef uint16_t u16;
 // ======================================================================
 #define CONTROL_SERVICE_UUID "00010000-0000-1000-8000-00805f9b34fb"
 #define COMMAND_CHAR_UUID "00010001-0000-1000-8000-00805f9b34fb"
+#define ACK_CHAR_UUID "00010002-0000-1000-8000-00805f9b34fb"
 
 #define FEEDBACK_SERVICE_UUID "00020000-0000-1000-8000-00805f9b34fb"
 //===============Characteristics================
 #define BATTERY_CHAR_UUID "00020001-0000-1000-8000-00805f9b34fb"
 #define DISTANCE_FEEDBACK_CHAR_UUID "00020002-0000-1000-8000-00805f9b34fb"
 #define BASE_FEEDBACK_CHAR_UUID "00020003-0000-1000-8000-00805f9b34fb"
+#define DIAGNOSTICS_CHAR_UUID "00020004-0000-1000-8000-00805f9b34fb"
+#define STATE_CHAR_UUID "00020005-0000-1000-8000-00805f9b34fb"
+#define HISTORY_CHAR_UUID "00020006-0000-1000-8000-00805f9b34fb"
 
 #define SERVOS_FEEDBACK_SERVICE_UUID "00030000-0000-1000-8000-00805f9b34fb"
 //===============Characteristics===============
@@ -87,6 +177,7 @@ typedef uint16_t u16;
 #define LEFT_HAND_SERVOS_FEEDBACK_CHAR_UUID "00030002-0000-1000-8000-00805f9b34fb"
 #define HEAD_HAND_SERVOS_FEEDBACK_CHAR_UUID "00030003-0000-1000-8000-00805f9b34fb"
 #define SERVO_FEEDBACK_CHAR_UUID "00030004-0000-1000-8000-00805f9b34fb"
+#define FAST_FEEDBACK_CHAR_UUID "00030005-0000-1000-8000-00805f9b34fb"
 
 // ======================================================================
 // Servo Definitions - Updated to match Dart model
@@ -111,8 +202,30 @@ typedef uint16_t u16;
 // Total number of servos
 #define TOTAL_SERVOS 14
 
-// Servo name strings for JSON processing
-extern const char *SERVO_NAMES[TOTAL_SERVOS];
+// Servo bitmasks (bit n = servo index n)
+#define RIGHT_HAND_MASK 0x003F
+#define LEFT_HAND_MASK 0x0FC0
+#define HEAD_MASK 0x3000
+#define ALL_SERVOS_MASK 0x3FFF
+
+// Servo name strings for JSON processing - Exactly matching names from robot_model.dart
+// constexpr so the name lookup table is built at compile time
+constexpr const char *SERVO_NAMES[TOTAL_SERVOS] = {
+    "rightGripper",
+    "rightWrist",
+    "rightElbow",
+    "rightSholderYaw",
+    "rightSholderRoll",
+    "rightSholderPitch",
+    "leftGripper",
+    "leftWrist",
+    "leftElbow",
+    "leftSholderYaw",
+    "leftSholderRoll",
+    "leftSholderPitch",
+    "headPan",
+    "headTilt",
+};
 
 // Data Type definitions
 #define RIGHT_HAND_GROUP "rightHand"
@@ -122,6 +235,11 @@ extern const char *SERVO_NAMES[TOTAL_SERVOS];
 #define BASE "base"
 #define DISTANCE "distance"
 #define SERVO "servo"
+#define BODY "body"
+#define DIAGNOSTICS "diagnostics"
+#define STATE "state"
+#define HISTORY "history"
+#define FAST "fast"
 
 // ======================================================================
 // Global Variables (defined in main.ino, declared as extern here)
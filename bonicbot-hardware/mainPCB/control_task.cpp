@@ -0,0 +1,459 @@
+#include "control_task.h"
+#include "communication.h"
+#include "motor_control.h"
+#include "sensors.h"
+#include "command_trace.h"
+#include "telemetry_history.h"
+#include "fast_stream.h"
+#include "servo_health.h"
+#include "servo_bus.h"
+
+static QueueHandle_t controlQueue = nullptr;
+static TaskHandle_t controlTaskHandle = nullptr;
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+static ControlTaskStats stats = {};
+
+// Coalescing slots, newest target wins per field
+static portMUX_TYPE slotLock = portMUX_INITIALIZER_UNLOCKED;
+static ServoTargets pendingServos = {};
+static int16_t pendingBase[2] = {0, 0};
+static bool basePending = false;
+static bool markerQueued = false;
+
+// Newest sequence id merged into the slots
+static bool seqPending = false;
+static uint16_t pendingSeq = 0;
+static uint32_t pendingSeqReceivedAt = 0;
+
+// Older ids it replaced, acked as superseded with the next write
+static uint8_t supersededCount = 0;
+static uint16_t supersededSeq[ACK_SUPERSEDED_MAX];
+static uint32_t supersededReceivedAt[ACK_SUPERSEDED_MAX];
+
+// Servo targets go out on the bus task while the base is driven here. Two
+// writes alternate, so the next targets queue behind the write on the wire
+// and the task only waits when both are still in flight.
+struct ServoWrite
+{
+  ServoTransaction transaction;
+  CommandTrace trace;       // recorded once the write is done
+  bool traced;              // trace is waiting for the write
+  volatile uint32_t doneAt; // micros() when the bus task finished it
+};
+
+static ServoWrite servoWrites[2];
+static uint8_t nextServoWrite = 0;
+
+static const uint16_t GROUP_MASKS[3] = {RIGHT_HAND_MASK, LEFT_HAND_MASK, HEAD_MASK};
+
+// Merge targets into the pending slot
+static void mergeServoTargets(const ServoTargets &targets)
+{
+  uint16_t incoming = targets.mask | targets.speedMask | targets.accMask;
+  uint16_t pending = pendingServos.mask | pendingServos.speedMask | pendingServos.accMask;
+
+  for (int group = 0; group < 3; group++)
+  {
+    if ((incoming & GROUP_MASKS[group]) && (pending & GROUP_MASKS[group]))
+      stats.servoSuperseded[group]++;
+  }
+
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    uint16_t bit = 1 << i;
+    if (targets.mask & bit)
+      pendingServos.angle[i] = targets.angle[i];
+    if (targets.speedMask & bit)
+      pendingServos.speed[i] = targets.speed[i];
+    if (targets.accMask & bit)
+      pendingServos.acc[i] = targets.acc[i];
+  }
+  pendingServos.mask |= targets.mask;
+  pendingServos.speedMask |= targets.speedMask;
+  pendingServos.accMask |= targets.accMask;
+}
+
+static void mergeBase(int16_t left, int16_t right)
+{
+  if (basePending)
+    stats.baseSuperseded++;
+
+  pendingBase[0] = left;
+  pendingBase[1] = right;
+  basePending = true;
+}
+
+// Make seq the pending id, keeping the one it replaces for a superseded ack
+static void mergeSeq(uint16_t seq, uint32_t receivedAt)
+{
+  if (seqPending)
+  {
+    if (supersededCount < ACK_SUPERSEDED_MAX)
+    {
+      supersededSeq[supersededCount] = pendingSeq;
+      supersededReceivedAt[supersededCount] = pendingSeqReceivedAt;
+      supersededCount++;
+    }
+    else
+    {
+      stats.supersededUnacked++;
+    }
+  }
+
+  seqPending = true;
+  pendingSeq = seq;
+  pendingSeqReceivedAt = receivedAt;
+}
+
+// Runs on the bus task when a write is done
+static void servoWriteDone(ServoTransaction &transaction)
+{
+  ((ServoWrite *)transaction.context)->doneAt = micros();
+}
+
+// Record the traces of finished writes, oldest first
+static void reapServoWrites()
+{
+  for (int i = 0; i < 2; i++)
+  {
+    ServoWrite &write = servoWrites[(nextServoWrite + i) % 2];
+    if (!write.traced || !servoTransactionDone(write.transaction))
+      continue;
+
+    write.trace.busDoneAt = write.doneAt;
+    write.traced = false;
+    recordCommandTrace(write.trace);
+  }
+}
+
+// Wait for every write in flight, so a blocking servo call can not
+// overtake queued targets
+static void drainServoWrites()
+{
+  for (int i = 0; i < 2; i++)
+    waitServoTransaction(servoWrites[(nextServoWrite + i) % 2].transaction);
+  reapServoWrites();
+}
+
+// Ticks until a write in flight should be checked, portMAX_DELAY if none
+static TickType_t servoWriteWait()
+{
+  return servoWrites[0].traced || servoWrites[1].traced ? 1 : portMAX_DELAY;
+}
+
+// Claim the marker, returns true if the caller must queue it
+static bool claimMarker()
+{
+  if (markerQueued)
+    return false;
+  markerQueued = true;
+  return true;
+}
+
+// Take both pending slots and execute them back to back. Returns true if
+// the trace went with the servo write and is recorded once it is done.
+static bool flushActuators(CommandTrace &trace)
+{
+  ServoTargets targets;
+  int16_t left, right;
+
+  portENTER_CRITICAL(&slotLock);
+  targets = pendingServos;
+  memset(&pendingServos, 0, sizeof(pendingServos));
+  bool hasBase = basePending;
+  left = pendingBase[0];
+  right = pendingBase[1];
+  basePending = false;
+  markerQueued = false;
+  if (seqPending)
+  {
+    trace.sequenced = true;
+    trace.seq = pendingSeq;
+    trace.receivedAt = pendingSeqReceivedAt;
+    seqPending = false;
+  }
+  trace.superseded = supersededCount;
+  memcpy(trace.supersededSeq, supersededSeq, supersededCount * sizeof(supersededSeq[0]));
+  memcpy(trace.supersededReceivedAt, supersededReceivedAt, supersededCount * sizeof(supersededReceivedAt[0]));
+  supersededCount = 0;
+  portEXIT_CRITICAL(&slotLock);
+
+  ServoWrite *write = nullptr;
+  if (targets.mask | targets.speedMask | targets.accMask)
+  {
+    // Reuse the older buffer once its write is done
+    write = &servoWrites[nextServoWrite];
+    waitServoTransaction(write->transaction);
+    reapServoWrites();
+
+    // A full queue holds the write until there is room behind it, the
+    // targets never bypass queued transactions
+    write->transaction.targets = targets;
+    if (submitServoTransaction(write->transaction, portMAX_DELAY))
+      nextServoWrite ^= 1;
+    else
+      write = nullptr;
+  }
+  if (hasBase)
+    setMotorSpeeds(left, right);
+
+  if (write == nullptr)
+    return false;
+
+  write->trace = trace;
+  write->traced = true;
+  return true;
+}
+
+// Run slots whose marker was lost to a full queue. The queue was full, so
+// the task gets here again soon after and nothing stays pending.
+static void flushOrphanedSlots()
+{
+  portENTER_CRITICAL(&slotLock);
+  bool orphaned = !markerQueued &&
+                  (basePending || (pendingServos.mask | pendingServos.speedMask | pendingServos.accMask));
+  if (orphaned)
+    markerQueued = true;
+  portEXIT_CRITICAL(&slotLock);
+
+  if (!orphaned)
+    return;
+
+  CommandTrace trace;
+  trace.sequenced = false;
+  trace.seq = 0;
+  trace.superseded = 0;
+  trace.dequeuedAt = micros();
+  trace.receivedAt = trace.dequeuedAt;
+  trace.busStartAt = trace.dequeuedAt;
+  if (flushActuators(trace))
+    return;
+  trace.busDoneAt = micros();
+  recordCommandTrace(trace);
+}
+
+static void executeTelemetryCommand(const ControlCommand &command)
+{
+  DataType dataType = command.telemetry.dataType;
+
+  switch (command.telemetry.commandType)
+  {
+  case COMMAND_RECEIVE_SINGLE:
+    if (dataType == DATA_HISTORY)
+      requestHistoryDownload(command.telemetry.fromMs, command.telemetry.toMs);
+    else
+      sendDataBasedOnDataType(dataType, 0, command.telemetry.servoIndex, &command.telemetry.options);
+    break;
+  case COMMAND_RECEIVE_CONTINUOUS:
+    if (dataType == DATA_FAST)
+      startFastStream(command.telemetry.servoMask, command.telemetry.interval);
+    else
+        sendDataBasedOnDataType(dataType, command.telemetry.interval, command.telemetry.servoIndex,
+                              &command.telemetry.options);
+    break;
+  case COMMAND_STOP_RECEIVE:
+    if (command.telemetry.stopAll)
+    {
+      stopAllContinuousDataSending();
+    }
+    stopContinuousDataSending(dataType);
+    break;
+  default:
+    break;
+  }
+}
+
+// Tell the client a scheduled command was not executed
+static void reportLateCommand(const ControlCommand &command)
+{
+  JsonDocument &lateDoc = beginStatusDocument("late");
+  if (command.sequenced)
+    lateDoc["seq"] = command.seq;
+  lateDoc["lateUs"] = command.late.lateUs;
+  sendStatusDocument();
+
+  LOG_WARN(COMMAND_LATE, command.late.lateUs);
+}
+
+// Execute a command, returns true if its trace waits for a servo write
+static bool executeControlCommand(const ControlCommand &command, CommandTrace &trace)
+{
+  trace.busStartAt = micros();
+
+  switch (command.kind)
+  {
+  case CONTROL_SERVOS:
+  case CONTROL_BASE:
+  case CONTROL_BODY:
+    if (flushActuators(trace))
+      return true;
+    break;
+  case CONTROL_HEAD_MODE:
+    setHeadMode(command.headMode);
+    break;
+  case CONTROL_SERVO_MIDDLE:
+    drainServoWrites();
+    setServoMiddle(command.servoIndex);
+    break;
+  case CONTROL_SERVO_RELEASE:
+    drainServoWrites();
+    releaseServo(command.servoIndex);
+    break;
+  case CONTROL_TELEMETRY:
+    executeTelemetryCommand(command);
+    break;
+  case CONTROL_LATE:
+    reportLateCommand(command);
+    break;
+  }
+
+  trace.busDoneAt = micros();
+  return false;
+}
+
+static void controlTask(void *param)
+{
+  ControlCommand command;
+
+  for (;;)
+  {
+    TickType_t wait = min(min(commandAckWait(), servoPingWait()), servoWriteWait());
+    if (xQueueReceive(controlQueue, &command, wait) != pdTRUE)
+    {
+      reapServoWrites();
+      flushCommandAcks(false);
+      flushOrphanedSlots();
+      pingQuarantinedServos();
+      continue;
+    }
+
+    uint32_t dequeuedAt = micros();
+    uint32_t latency = dequeuedAt - command.enqueuedAt;
+
+    portENTER_CRITICAL(&statsLock);
+    stats.lastLatencyUs = latency;
+    if (latency > stats.maxLatencyUs)
+      stats.maxLatencyUs = latency;
+    stats.avgLatencyUs = stats.executed == 0 ? latency : (stats.avgLatencyUs * 7 + latency) / 8;
+    stats.executed++;
+    portEXIT_CRITICAL(&statsLock);
+
+    CommandTrace trace;
+    trace.sequenced = command.sequenced;
+    trace.seq = command.seq;
+    trace.receivedAt = command.receivedAt;
+    trace.dequeuedAt = dequeuedAt;
+    trace.superseded = 0;
+    bool writing = executeControlCommand(command, trace);
+    if (!writing && command.kind != CONTROL_LATE)
+      recordCommandTrace(trace);
+    reapServoWrites();
+    flushOrphanedSlots();
+
+    // A busy queue must not starve the quarantine pings
+    pingQuarantinedServos();
+  }
+}
+
+// Create the queue and start the task
+void initializeControlTask()
+{
+  controlQueue = xQueueCreate(CONTROL_QUEUE_LENGTH, sizeof(ControlCommand));
+  for (ServoWrite &write : servoWrites)
+  {
+    initServoTransaction(write.transaction, SERVO_TRANSACTION_TARGETS);
+    write.transaction.done = servoWriteDone;
+    write.transaction.context = &write;
+    write.traced = false;
+  }
+  xTaskCreatePinnedToCore(controlTask, "control", CONTROL_TASK_STACK, nullptr,
+                          CONTROL_TASK_PRIORITY, &controlTaskHandle, CONTROL_TASK_CORE);
+
+  LOG_INFO(CONTROL_TASK_STARTED);
+}
+
+// Queue a decoded command, returns false if it was dropped
+bool enqueueControlCommand(ControlCommand &command)
+{
+  command.enqueuedAt = micros();
+
+  // Actuator commands only queue a marker if none is waiting
+  bool actuator = command.kind == CONTROL_SERVOS || command.kind == CONTROL_BASE || command.kind == CONTROL_BODY;
+  if (actuator)
+  {
+    bool needsMarker;
+
+    portENTER_CRITICAL(&slotLock);
+    portENTER_CRITICAL(&statsLock);
+    if (command.sequenced)
+      mergeSeq(command.seq, command.receivedAt);
+    if (command.kind == CONTROL_SERVOS)
+      mergeServoTargets(command.servos);
+    else if (command.kind == CONTROL_BASE)
+      mergeBase(command.base.left, command.base.right);
+    else
+    {
+      mergeServoTargets(command.body.servos);
+      if (command.body.hasBase)
+        mergeBase(command.body.left, command.body.right);
+    }
+    needsMarker = claimMarker();
+    portEXIT_CRITICAL(&statsLock);
+    portEXIT_CRITICAL(&slotLock);
+
+    if (!needsMarker)
+      return true;
+  }
+
+  if (controlQueue == nullptr || xQueueSend(controlQueue, &command, 0) != pdTRUE)
+  {
+    // The targets stay merged, the control task runs them without a
+    // marker once it finishes the command at hand
+    if (actuator && controlQueue != nullptr)
+    {
+      portENTER_CRITICAL(&slotLock);
+      markerQueued = false;
+      portEXIT_CRITICAL(&slotLock);
+      return true;
+    }
+
+    // No task to run them yet, drop the merged targets too
+    if (actuator)
+    {
+      portENTER_CRITICAL(&slotLock);
+      memset(&pendingServos, 0, sizeof(pendingServos));
+      basePending = false;
+      seqPending = false;
+      supersededCount = 0;
+      markerQueued = false;
+      portEXIT_CRITICAL(&slotLock);
+    }
+
+    portENTER_CRITICAL(&statsLock);
+    stats.dropped++;
+    portEXIT_CRITICAL(&statsLock);
+
+    LOG_WARN(CONTROL_QUEUE_FULL);
+    return false;
+  }
+
+  uint32_t depth = uxQueueMessagesWaiting(controlQueue);
+
+  portENTER_CRITICAL(&statsLock);
+  stats.enqueued++;
+  if (depth > stats.maxDepth)
+    stats.maxDepth = depth;
+  portEXIT_CRITICAL(&statsLock);
+
+  return true;
+}
+
+// Snapshot of queue statistics
+void getControlTaskStats(ControlTaskStats &out)
+{
+  portENTER_CRITICAL(&statsLock);
+  out = stats;
+  portEXIT_CRITICAL(&statsLock);
+
+  out.depth = controlQueue ? uxQueueMessagesWaiting(controlQueue) : 0;
+}
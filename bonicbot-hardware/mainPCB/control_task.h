@@ -0,0 +1,114 @@
+#ifndef CONTROL_TASK_H
+#define CONTROL_TASK_H
+
+#include <Arduino.h>
+#include "configs.h"
+#include "protocol.h"
+#include "servo_control.h"
+#include "telemetry.h"
+
+// ======================================================================
+// Control Task
+// ======================================================================
+// BLE and serial receivers decode commands into ControlCommand values and
+// enqueue them. A pinned task executes them, so bus traffic never runs on
+// the Bluedroid callback task.
+//
+// Servo, base and body commands are coalesced: they are merged field by
+// field into pending servo and base slots and only one marker is queued,
+// so the task always acts on the newest targets instead of a backlog. A
+// marker flushes both slots, servos first and the base right after. The
+// servo write is submitted to the bus task (servo_bus.h), so the base is
+// driven while the servo frame is still on the wire, and the task moves
+// on without waiting: the next write queues behind it, in order. The
+// command is traced and acked once its write is done. If the queue is
+// full when a marker is due, the targets stay merged and the task runs
+// them after the command at hand, they are never dropped.
+//
+// Executed commands are traced through command_trace.h, the task wakes up
+// on its own to send acks that are waiting for a batch and to ping
+// quarantined servos (servo_health.h).
+
+enum ControlCommandKind : uint8_t
+{
+  CONTROL_SERVOS,        // move any subset of servos
+  CONTROL_BASE,          // set base motor speeds
+  CONTROL_BODY,          // servos and base together
+  CONTROL_HEAD_MODE,     // send a mode string to the eye board
+  CONTROL_SERVO_MIDDLE,  // calibrate servo middle position
+  CONTROL_SERVO_RELEASE, // disable servo torque
+  CONTROL_TELEMETRY,     // start, stop or read a telemetry stream
+  CONTROL_LATE,          // report a scheduled command that missed its time
+};
+
+struct ControlCommand
+{
+  ControlCommandKind kind;
+  bool sequenced;      // seq is valid and an ack is wanted
+  uint16_t seq;        // client sequence id
+  uint32_t receivedAt; // micros() when the write arrived
+  bool scheduled;      // hold until executeAt (command_schedule.h)
+  uint32_t executeAt;  // micros() deadline
+  uint32_t enqueuedAt; // micros() when queued
+  union
+  {
+    ServoTargets servos;
+    struct
+    {
+      int16_t left;
+      int16_t right;
+    } base;
+    struct
+    {
+      ServoTargets servos;
+      int16_t left;
+      int16_t right;
+      bool hasBase;
+    } body;
+    char headMode[16];
+    int8_t servoIndex;
+    struct
+    {
+      DataType dataType;
+      CommandType commandType;
+      int interval;
+      int8_t servoIndex;
+      bool stopAll;
+      TelemetryOptions options;
+      uint32_t fromMs; // history download window
+      uint32_t toMs;
+      uint16_t servoMask; // fast stream servos
+    } telemetry;
+    struct
+    {
+      ControlCommandKind kind;
+      uint32_t lateUs;
+    } late;
+  };
+};
+
+struct ControlTaskStats
+{
+  uint32_t enqueued;     // commands accepted
+  uint32_t dropped;      // commands rejected because the queue was full
+  uint32_t executed;     // commands executed
+  uint32_t depth;        // commands currently waiting
+  uint32_t maxDepth;     // highest depth seen
+  uint32_t lastLatencyUs; // enqueue-to-execute latency of the last command
+  uint32_t maxLatencyUs;
+  uint32_t avgLatencyUs; // moving average
+  uint32_t servoSuperseded[3]; // per servo group, indexed by DataType
+  uint32_t baseSuperseded;
+  uint32_t supersededUnacked; // sequence ids merged over past ACK_SUPERSEDED_MAX
+};
+
+// Create the queue and start the task
+void initializeControlTask();
+
+// Queue a decoded command, returns false if it was dropped
+bool enqueueControlCommand(ControlCommand &command);
+
+// Snapshot of queue statistics
+void getControlTaskStats(ControlTaskStats &stats);
+
+#endif // CONTROL_TASK_H
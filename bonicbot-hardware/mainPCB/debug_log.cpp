@@ -0,0 +1,184 @@
+#include "debug_log.h"
+#include <atomic>
+#include "usb_link.h"
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two");
+
+// Bounded multi-producer ring. A slot is free for the producer that
+// claims position pos when its sequence is pos, and holds a record for
+// the drain task when it is pos + 1.
+struct LogSlot
+{
+  std::atomic<uint32_t> sequence; // stored minus the slot index, see slotSequence
+  uint32_t timestamp;
+  LogMessage id;
+  uint8_t level;
+  LogArgs args;
+};
+
+struct RateWindow
+{
+  std::atomic<uint32_t> start; // millis() the window opened
+  std::atomic<uint32_t> count;
+  std::atomic<uint32_t> suppressed; // not yet reported
+};
+
+static LogSlot ring[LOG_RING_SIZE];
+static std::atomic<uint32_t> writePos(0);
+static uint32_t readPos = 0; // drain task only
+
+static RateWindow windows[LOG_MESSAGE_COUNT];
+static std::atomic<uint32_t> droppedPending(0);
+
+static std::atomic<uint32_t> logged(0);
+static std::atomic<uint32_t> sent(0);
+static std::atomic<uint32_t> suppressedTotal(0);
+static std::atomic<uint32_t> droppedTotal(0);
+
+// Sequences are stored relative to the slot index, so the zeroed ring
+// starts with every slot free for its first lap
+static uint32_t slotSequence(uint32_t index)
+{
+  return ring[index].sequence.load(std::memory_order_acquire) + index;
+}
+
+static void setSlotSequence(uint32_t index, uint32_t sequence)
+{
+  ring[index].sequence.store(sequence - index, std::memory_order_release);
+}
+
+// Count the record against its message's window, false if over the limit
+static bool withinRate(LogMessage id, uint32_t now)
+{
+  RateWindow &window = windows[id];
+  uint32_t start = window.start.load(std::memory_order_relaxed);
+  if (now - start >= LOG_RATE_WINDOW_MS &&
+      window.start.compare_exchange_strong(start, now, std::memory_order_relaxed))
+    window.count.store(0, std::memory_order_relaxed);
+
+  if (window.count.fetch_add(1, std::memory_order_relaxed) < LOG_RATE_BURST)
+    return true;
+
+  window.suppressed.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+// Queue one record, never blocks
+void logRecord(uint8_t level, LogMessage id, const LogArgs &args)
+{
+  uint32_t now = millis();
+  if (!withinRate(id, now))
+    return;
+
+  uint32_t pos = writePos.load(std::memory_order_relaxed);
+  uint32_t index;
+  for (;;)
+  {
+    index = pos & (LOG_RING_SIZE - 1);
+    int32_t diff = (int32_t)(slotSequence(index) - pos);
+    if (diff == 0)
+    {
+      if (writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    }
+    else if (diff < 0)
+    {
+      // The drain task has not caught up a full lap
+      droppedPending.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    else
+    {
+      pos = writePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  LogSlot &slot = ring[index];
+  slot.timestamp = now;
+  slot.id = id;
+  slot.level = level;
+  slot.args.len = args.len;
+  memcpy(slot.args.data, args.data, args.len);
+  setSlotSequence(index, pos + 1);
+
+  logged.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void sendRecord(uint8_t level, LogMessage id, uint32_t timestamp, const LogArgs &args)
+{
+  uint8_t payload[7 + LOG_RECORD_DATA];
+  payload[0] = level;
+  payload[1] = id & 0xFF;
+  payload[2] = id >> 8;
+  memcpy(payload + 3, &timestamp, 4);
+  memcpy(payload + 7, args.data, args.len);
+  usbLinkSend(LINK_TYPE_LOG, LINK_CHANNEL_NONE, payload, 7 + args.len);
+
+  sent.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Report what the rate limit and a full ring threw away
+static void sendLossRecords()
+{
+  for (uint16_t i = 0; i < LOG_MESSAGE_COUNT; i++)
+  {
+    uint32_t suppressed = windows[i].suppressed.exchange(0, std::memory_order_relaxed);
+    if (suppressed == 0)
+      continue;
+
+    suppressedTotal.fetch_add(suppressed, std::memory_order_relaxed);
+    LogArgs args;
+    args.len = 0;
+    logPack(args, suppressed);
+    logPack(args, i);
+    sendRecord(LOG_LEVEL_WARN, LOG_SUPPRESSED, millis(), args);
+  }
+
+  uint32_t dropped = droppedPending.exchange(0, std::memory_order_relaxed);
+  if (dropped != 0)
+  {
+    droppedTotal.fetch_add(dropped, std::memory_order_relaxed);
+    LogArgs args;
+    args.len = 0;
+    logPack(args, dropped);
+    sendRecord(LOG_LEVEL_WARN, LOG_DROPPED, millis(), args);
+  }
+}
+
+static void logTask(void *param)
+{
+  for (;;)
+  {
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+
+    for (;;)
+    {
+      uint32_t index = readPos & (LOG_RING_SIZE - 1);
+      if (slotSequence(index) != readPos + 1)
+        break;
+
+      const LogSlot &slot = ring[index];
+      sendRecord(slot.level, slot.id, slot.timestamp, slot.args);
+      setSlotSequence(index, readPos + LOG_RING_SIZE);
+      readPos++;
+    }
+
+    sendLossRecords();
+  }
+}
+
+// Start the drain task, the USB link must already be initialized
+void initializeLog()
+{
+  xTaskCreatePinnedToCore(logTask, "log", LOG_TASK_STACK, nullptr,
+                          LOG_TASK_PRIORITY, nullptr, LOG_TASK_CORE);
+}
+
+// Snapshot of log counters
+void getLogStats(LogStats &stats)
+{
+  stats.logged = logged.load(std::memory_order_relaxed);
+  stats.sent = sent.load(std::memory_order_relaxed);
+  stats.suppressed = suppressedTotal.load(std::memory_order_relaxed);
+  stats.dropped = droppedTotal.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,131 @@
+#ifndef DEBUG_LOG_H
+#define DEBUG_LOG_H
+
+#include <Arduino.h>
+#include <type_traits>
+#include "configs.h"
+
+// ======================================================================
+// Debug Log
+// ======================================================================
+// Log calls never touch Serial. LOG_ERROR .. LOG_DEBUG copy a message id
+// and its arguments into a fixed record of a lock-free ring and return,
+// records above LOG_LEVEL are compiled out. A low-priority task drains
+// the ring and sends each record as a LINK_TYPE_LOG packet on the USB
+// link, tools/decode_log.py turns them back into text with the format
+// strings of log_messages.h.
+//
+// Each message id may log LOG_RATE_BURST records per LOG_RATE_WINDOW_MS,
+// the rest are counted and reported as one SUPPRESSED record. Records
+// that find the ring full are counted and reported as DROPPED.
+//
+// Record payload, little endian:
+//   [0]     level (LOG_LEVEL_*)
+//   [1..2]  message id
+//   [3..6]  millis()
+//   [7..]   arguments: 4 bytes per number, strings as a length byte
+//           followed by the characters
+
+enum LogMessage : uint16_t
+{
+#define LOG_MESSAGE(id, format) LOG_##id,
+#include "log_messages.h"
+#undef LOG_MESSAGE
+  LOG_MESSAGE_COUNT,
+};
+
+// Argument bytes of one record
+#define LOG_RECORD_DATA 36
+
+struct LogArgs
+{
+  uint8_t data[LOG_RECORD_DATA];
+  uint8_t len;
+};
+
+// Numbers are 4 bytes, the format string decides how they are read
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+logPack(LogArgs &args, T value)
+{
+  if (args.len + 4 > LOG_RECORD_DATA)
+    return;
+  uint32_t word = (uint32_t)value;
+  memcpy(args.data + args.len, &word, 4);
+  args.len += 4;
+}
+
+inline void logPack(LogArgs &args, double value)
+{
+  if (args.len + 4 > LOG_RECORD_DATA)
+    return;
+  float f = value;
+  memcpy(args.data + args.len, &f, 4);
+  args.len += 4;
+}
+
+// Strings are copied, so temporaries are safe to log
+inline void logPack(LogArgs &args, const char *value)
+{
+  if (args.len + 1 > LOG_RECORD_DATA)
+    return;
+  size_t n = value != nullptr ? strnlen(value, LOG_RECORD_DATA) : 0;
+  if (n > LOG_RECORD_DATA - args.len - 1u)
+    n = LOG_RECORD_DATA - args.len - 1;
+  args.data[args.len++] = n;
+  memcpy(args.data + args.len, value, n);
+  args.len += n;
+}
+
+// Queue one record, never blocks
+void logRecord(uint8_t level, LogMessage id, const LogArgs &args);
+
+template <typename... Args>
+inline void logWrite(uint8_t level, LogMessage id, Args... values)
+{
+  LogArgs args;
+  args.len = 0;
+  int expand[] = {0, (logPack(args, values), 0)...};
+  (void)expand;
+  logRecord(level, id, args);
+}
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(id, ...) logWrite(LOG_LEVEL_ERROR, LOG_##id, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(id, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(id, ...) logWrite(LOG_LEVEL_WARN, LOG_##id, ##__VA_ARGS__)
+#else
+#define LOG_WARN(id, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(id, ...) logWrite(LOG_LEVEL_INFO, LOG_##id, ##__VA_ARGS__)
+#else
+#define LOG_INFO(id, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(id, ...) logWrite(LOG_LEVEL_DEBUG, LOG_##id, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(id, ...) do {} while (0)
+#endif
+
+struct LogStats
+{
+  uint32_t logged;     // records queued
+  uint32_t sent;       // records sent by the drain task
+  uint32_t suppressed; // records over their message's rate limit
+  uint32_t dropped;    // records that found the ring full
+};
+
+// Start the drain task, the USB link must already be initialized
+void initializeLog();
+
+// Snapshot of log counters
+void getLogStats(LogStats &stats);
+
+#endif // DEBUG_LOG_H
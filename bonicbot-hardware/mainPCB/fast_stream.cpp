@@ -0,0 +1,328 @@
+#include "fast_stream.h"
+#include "communication.h"
+#include "servo_bus.h"
+
+static portMUX_TYPE fastLock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t fastTaskHandle = nullptr;
+static FastStreamStats stats = {};
+
+// Latest request, read by the task when notified
+static bool requestStart = false;
+static uint16_t requestMask = 0;
+static int requestMs = 0;
+
+// Polls go through the bus queue, behind any servo write sent before them
+static ServoTransaction pollRead;
+
+// Servo write load, sampled by the fast task only
+static uint32_t loadSampleAt = 0;
+static uint32_t loadSampleBusyUs = 0;
+static uint32_t writeLoad = 0; // percent
+
+// Average the bus share of servo writes over the window that just ended
+static void updateWriteLoad()
+{
+  ServoBusStats busStats;
+  getServoBusStats(busStats);
+
+  uint32_t now = micros();
+  uint32_t spanUs = now - loadSampleAt;
+  if (spanUs < FAST_STREAM_LOAD_WINDOW_MS * 1000UL)
+    return;
+
+  uint32_t busyUs = busStats.targetsBusyUs - loadSampleBusyUs;
+  uint32_t load = (uint32_t)((uint64_t)busyUs * 100 / spanUs);
+  writeLoad = (writeLoad + min(load, (uint32_t)100)) / 2;
+  loadSampleAt = now;
+  loadSampleBusyUs = busStats.targetsBusyUs;
+
+  portENTER_CRITICAL(&fastLock);
+  stats.writeLoad = writeLoad;
+  portEXIT_CRITICAL(&fastLock);
+}
+
+// Percent of the bus the poller may take next to the servo writes
+static uint32_t busBudget()
+{
+  if (writeLoad + FAST_STREAM_MIN_BUS_BUDGET >= FAST_STREAM_BUS_BUDGET)
+    return FAST_STREAM_MIN_BUS_BUDGET;
+  return FAST_STREAM_BUS_BUDGET - writeLoad;
+}
+
+// Bus time one poll of cycleUs needs, as an interval in ms
+static uint32_t budgetIntervalMs(uint32_t cycleUs)
+{
+  uint32_t budget = busBudget();
+  return (cycleUs * 100 + budget * 1000 - 1) / (budget * 1000);
+}
+
+static void sendFastStatus()
+{
+  portENTER_CRITICAL(&fastLock);
+  FastStreamStats snapshot = stats;
+  portEXIT_CRITICAL(&fastLock);
+
+  JsonDocument &statusDoc = beginStatusDocument(FAST);
+  statusDoc["intervalMs"] = snapshot.intervalMs;
+  statusDoc["requestedMs"] = snapshot.requestedMs;
+  statusDoc["cycleUs"] = snapshot.cycleUs;
+  statusDoc["degraded"] = snapshot.intervalMs > snapshot.requestedMs;
+  sendStatusDocument();
+}
+
+static void sendFastRefused(const char *reason)
+{
+  JsonDocument &statusDoc = beginStatusDocument("fast refused");
+  statusDoc["reason"] = reason;
+  sendStatusDocument();
+
+  LOG_WARN(FAST_REFUSED, reason);
+}
+
+// Read the servos of mask into frame, returns the frame length. cycleUs
+// is the bus time of the read, not the wait behind queued transactions.
+static size_t pollFrame(uint8_t *frame, uint16_t mask, uint16_t seq, uint32_t &cycleUs, int &answered)
+{
+  pollRead.mask = mask;
+  if (!submitServoTransaction(pollRead, portMAX_DELAY))
+  {
+    pollRead.answered = 0;
+    pollRead.busyUs = 0;
+    pollRead.startedAt = micros();
+    for (int i = 0; i < TOTAL_SERVOS; i++)
+      pollRead.feedback[i].status = SERVO_STATUS_NO_RESPONSE;
+  }
+  waitServoTransaction(pollRead);
+
+  const ServoFeedback *feedback = pollRead.feedback;
+  uint32_t start = pollRead.startedAt;
+  answered = pollRead.answered;
+  cycleUs = pollRead.busyUs;
+
+  frame[0] = FAST_FRAME_MAGIC;
+  frame[1] = seq & 0xFF;
+  frame[2] = seq >> 8;
+  memcpy(frame + 3, &start, 4);
+  frame[7] = mask & 0xFF;
+  frame[8] = mask >> 8;
+
+  uint8_t *p = frame + FAST_FRAME_HEADER_SIZE;
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    if (!(mask & (1 << i)))
+      continue;
+
+    int16_t angle = FAST_ANGLE_NO_RESPONSE;
+    if (!(feedback[i].status & SERVO_STATUS_NO_RESPONSE))
+      angle = (int16_t)lroundf(servoFeedbackAngle(i, feedback[i].position) * 100);
+    int16_t speed = feedback[i].speed;
+    memcpy(p, &angle, 2);
+    memcpy(p + 2, &speed, 2);
+    p += FAST_FRAME_SERVO_SIZE;
+  }
+
+  return p - frame;
+}
+
+// A USB link packet carries 4 bytes of type, channel and CRC
+static_assert(FAST_FRAME_HEADER_SIZE + TOTAL_SERVOS * FAST_FRAME_SERVO_SIZE <= USB_LINK_MAX_PACKET - 4,
+              "fast frame exceeds a USB link packet");
+
+// Time one poll of the set and grant an interval the bus can keep up with
+static bool grantStream(uint16_t mask, int requestedMs)
+{
+  mask &= ALL_SERVOS_MASK;
+  if (mask == 0)
+    mask = ALL_SERVOS_MASK;
+  if (requestedMs < FAST_STREAM_MIN_INTERVAL_MS)
+    requestedMs = FAST_STREAM_MIN_INTERVAL_MS;
+
+#if COMM_METHOD == COMM_METHOD_BLE
+  if (!deviceConnected)
+  {
+    LOG_WARN(STREAM_NOT_CONNECTED);
+    return false;
+  }
+#endif
+
+#if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
+  // Only a connected BLE client limits the frame, USB takes any of them
+  size_t frameSize = FAST_FRAME_HEADER_SIZE + __builtin_popcount(mask) * FAST_FRAME_SERVO_SIZE;
+  if (deviceConnected && frameSize > connectionMtu - 3u)
+  {
+    sendFastRefused("frame exceeds MTU");
+    return false;
+  }
+#endif
+
+  uint8_t frame[FAST_FRAME_HEADER_SIZE + TOTAL_SERVOS * FAST_FRAME_SERVO_SIZE];
+  uint32_t cycleUs;
+  int answered;
+  pollFrame(frame, mask, 0, cycleUs, answered);
+  updateWriteLoad();
+  if (answered == 0)
+  {
+    sendFastRefused("no servo answered");
+    return false;
+  }
+
+  uint32_t intervalMs = budgetIntervalMs(cycleUs);
+  if (intervalMs < (uint32_t)requestedMs)
+    intervalMs = requestedMs;
+  if (intervalMs > FAST_STREAM_MAX_INTERVAL_MS)
+  {
+    sendFastRefused("bus too slow");
+    return false;
+  }
+
+  portENTER_CRITICAL(&fastLock);
+  stats.active = true;
+  stats.mask = mask;
+  stats.requestedMs = requestedMs;
+  stats.intervalMs = intervalMs;
+  stats.cycleUs = cycleUs;
+  if (stats.maxCycleUs < cycleUs)
+    stats.maxCycleUs = cycleUs;
+  if (intervalMs > (uint32_t)requestedMs)
+    stats.degraded++;
+  portEXIT_CRITICAL(&fastLock);
+
+  sendFastStatus();
+  LOG_INFO(FAST_STARTED, mask, requestedMs, intervalMs, cycleUs);
+  return true;
+}
+
+// One cycle of a running stream, false if it had to stop
+static bool runCycle(uint16_t seq)
+{
+  portENTER_CRITICAL(&fastLock);
+  uint16_t mask = stats.mask;
+  uint32_t intervalMs = stats.intervalMs;
+  portEXIT_CRITICAL(&fastLock);
+
+  uint8_t frame[FAST_FRAME_HEADER_SIZE + TOTAL_SERVOS * FAST_FRAME_SERVO_SIZE];
+  uint32_t cycleUs;
+  int answered;
+  size_t len = pollFrame(frame, mask, seq, cycleUs, answered);
+  sendResponse(frame, len, LINK_CHANNEL_FAST);
+  updateWriteLoad();
+
+  portENTER_CRITICAL(&fastLock);
+  stats.frames++;
+  stats.cycleUs = (stats.cycleUs * 7 + cycleUs) / 8;
+  if (stats.maxCycleUs < cycleUs)
+    stats.maxCycleUs = cycleUs;
+  if (cycleUs > intervalMs * 1000)
+    stats.overruns++;
+  uint32_t averageUs = stats.cycleUs;
+  portEXIT_CRITICAL(&fastLock);
+
+  // The bus got slower or busier than at the grant, stretch the interval
+  uint32_t neededMs = budgetIntervalMs(averageUs);
+  if (neededMs <= intervalMs)
+    return true;
+
+  if (neededMs > FAST_STREAM_MAX_INTERVAL_MS)
+  {
+    portENTER_CRITICAL(&fastLock);
+    stats.active = false;
+    portEXIT_CRITICAL(&fastLock);
+    sendFastRefused("bus too slow");
+    return false;
+  }
+
+  portENTER_CRITICAL(&fastLock);
+  stats.intervalMs = neededMs;
+  stats.degraded++;
+  portEXIT_CRITICAL(&fastLock);
+
+  sendFastStatus();
+  LOG_WARN(FAST_DEGRADED, averageUs, neededMs);
+  return true;
+}
+
+static void fastTask(void *param)
+{
+  bool running = false;
+  uint16_t seq = 0;
+  TickType_t lastWake = 0;
+
+  for (;;)
+  {
+    if (!running)
+    {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    else
+    {
+      portENTER_CRITICAL(&fastLock);
+      uint32_t intervalMs = stats.intervalMs;
+      portEXIT_CRITICAL(&fastLock);
+
+      vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(intervalMs));
+      if (ulTaskNotifyTake(pdTRUE, 0) == 0)
+      {
+        running = runCycle(seq++);
+        continue;
+      }
+    }
+
+    // A start or stop request arrived
+    portENTER_CRITICAL(&fastLock);
+    bool start = requestStart;
+    uint16_t mask = requestMask;
+    int requestedMs = requestMs;
+    stats.active = false;
+    portEXIT_CRITICAL(&fastLock);
+
+    if (running && !start)
+      LOG_INFO(FAST_STOPPED);
+
+    running = start && grantStream(mask, requestedMs);
+    seq = 0;
+    lastWake = xTaskGetTickCount();
+  }
+}
+
+// Start the poller task
+void initializeFastStream()
+{
+  initServoTransaction(pollRead, SERVO_TRANSACTION_FEEDBACK);
+  pollRead.ioTimeoutUs = FAST_STREAM_IO_TIMEOUT_US;
+  loadSampleAt = micros();
+
+  xTaskCreatePinnedToCore(fastTask, "fast", FAST_TASK_STACK, nullptr,
+                          FAST_TASK_PRIORITY, &fastTaskHandle, FAST_TASK_CORE);
+}
+
+static void requestFastStream(bool start, uint16_t mask, int requestedMs)
+{
+  if (fastTaskHandle == nullptr)
+    return;
+
+  portENTER_CRITICAL(&fastLock);
+  requestStart = start;
+  requestMask = mask;
+  requestMs = requestedMs;
+  portEXIT_CRITICAL(&fastLock);
+
+  xTaskNotifyGive(fastTaskHandle);
+}
+
+// Poll the servos of mask every requestedMs, or slower if the bus is busy
+void startFastStream(uint16_t mask, int requestedMs)
+{
+  requestFastStream(true, mask, requestedMs);
+}
+
+void stopFastStream()
+{
+  requestFastStream(false, 0, 0);
+}
+
+void getFastStreamStats(FastStreamStats &out)
+{
+  portENTER_CRITICAL(&fastLock);
+  out = stats;
+  portEXIT_CRITICAL(&fastLock);
+}
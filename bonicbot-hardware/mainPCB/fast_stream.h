@@ -0,0 +1,70 @@
+#ifndef FAST_STREAM_H
+#define FAST_STREAM_H
+
+#include <Arduino.h>
+#include "configs.h"
+
+// ======================================================================
+// Fast Servo Stream
+// ======================================================================
+// Positions of a chosen set of servos at up to 200 Hz, below the 100 ms
+// floor of the telemetry task. receiveContinuous on "fast" with optional
+// payload "servos" (servo or group names, default all servos) starts it,
+// stopReceive stops it. A dedicated task polls the set with one sync read
+// per cycle and sends a compact frame on the fast characteristic / USB
+// channel. Reads are submitted to the servo bus queue (servo_bus.h), so
+// servo writes go out between polls in the order they were sent.
+//
+// Before starting, the task times one sync read of the set. The granted
+// interval is the requested one (at least FAST_STREAM_MIN_INTERVAL_MS)
+// unless the poll would take more than the bus budget, then it is
+// stretched to fit. The budget is FAST_STREAM_BUS_BUDGET percent of the
+// bus less the share servo writes took over the last load window, but at
+// least FAST_STREAM_MIN_BUS_BUDGET. The stream is refused when no
+// servo answers, when even FAST_STREAM_MAX_INTERVAL_MS does not fit, or
+// when a frame does not fit one notification. While running, a cycle time
+// that grows past the budget stretches the interval again. Every grant
+// or change is reported with a status document:
+//   {"status":"fast","intervalMs","requestedMs","cycleUs","degraded"}
+// and a refusal with {"status":"fast refused","reason"}.
+//
+// Frame, little endian:
+//   [0]    FAST_FRAME_MAGIC
+//   [1..2] u16 sequence
+//   [3..6] u32 micros() when the read started
+//   [7..8] u16 servo mask
+// followed by, for each servo in the mask by index:
+//   i16 angle in centidegrees as reported by servoFeedbackAngle,
+//       FAST_ANGLE_NO_RESPONSE if the servo did not answer
+//   i16 raw speed
+
+#define FAST_FRAME_MAGIC 0xF3
+#define FAST_FRAME_HEADER_SIZE 9
+#define FAST_FRAME_SERVO_SIZE 4
+#define FAST_ANGLE_NO_RESPONSE INT16_MIN
+
+struct FastStreamStats
+{
+  bool active;
+  uint16_t mask;
+  uint16_t requestedMs;
+  uint16_t intervalMs; // granted interval
+  uint32_t frames;
+  uint32_t cycleUs;    // average poll time
+  uint32_t maxCycleUs;
+  uint32_t degraded;   // times the interval was stretched
+  uint32_t overruns;   // polls longer than the interval
+  uint8_t writeLoad;   // percent of bus time taken by servo writes
+};
+
+// Start the poller task
+void initializeFastStream();
+
+// Poll the servos of mask every requestedMs, or slower if the bus is busy
+void startFastStream(uint16_t mask, int requestedMs);
+
+void stopFastStream();
+
+void getFastStreamStats(FastStreamStats &stats);
+
+#endif // FAST_STREAM_H
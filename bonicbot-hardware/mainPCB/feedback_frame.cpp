@@ -0,0 +1,36 @@
+#include "feedback_frame.h"
+
+static void writeU16(uint8_t *p, uint16_t value)
+{
+  p[0] = value & 0xFF;
+  p[1] = value >> 8;
+}
+
+// Encode the servos in mask, returns the frame length
+size_t encodeFeedbackFrame(uint8_t *out, uint8_t group, uint16_t seq, uint32_t timestamp,
+                           uint16_t mask, const ServoFeedback *feedback, bool delta)
+{
+  out[0] = delta ? FEEDBACK_MAGIC_DELTA : FEEDBACK_MAGIC_V1;
+  out[1] = group;
+  writeU16(out + 2, seq);
+  writeU16(out + 4, timestamp & 0xFFFF);
+  writeU16(out + 6, timestamp >> 16);
+  writeU16(out + 8, mask);
+
+  uint8_t *p = out + FEEDBACK_HEADER_SIZE;
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    if (!(mask & (1 << i)))
+      continue;
+
+    const ServoFeedback &servo = feedback[i];
+    writeU16(p, (int16_t)lroundf(servoFeedbackAngle(i, servo.position) * 100));
+    writeU16(p + 2, servo.speed);
+    writeU16(p + 4, servo.load);
+    p[6] = servo.temperature;
+    p[7] = servo.status;
+    p += FEEDBACK_RECORD_SIZE;
+  }
+
+  return p - out;
+}
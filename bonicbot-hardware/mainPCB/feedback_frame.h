@@ -0,0 +1,39 @@
+#ifndef FEEDBACK_FRAME_H
+#define FEEDBACK_FRAME_H
+
+#include <Arduino.h>
+#include "configs.h"
+#include "servo_control.h"
+
+// ======================================================================
+// Packed Servo Feedback Frame
+// ======================================================================
+// Binary alternative to the JSON/MessagePack servo feedback documents,
+// chosen per subscription with "format": "packed". All values are little
+// endian.
+//
+//   [0]    magic + version (FEEDBACK_MAGIC_V1, FEEDBACK_MAGIC_DELTA)
+//   [1]    group id (FRAME_GROUP_*, FRAME_GROUP_ALL for a single servo)
+//   [2..3] u16 sequence, counts every frame of the stream
+//   [4..7] u32 timestamp, millis()
+//   [8..9] servo bitmask, bit n = SERVO_NAMES[n]
+//
+// followed by one 8 byte record per set bit, in index order:
+//   int16 angle in centidegrees (right hand mirrored as in JSON),
+//   int16 speed, int16 load, u8 temperature, u8 status (SERVO_STATUS_*)
+// All 14 servos take 122 bytes.
+//
+// A delta frame only holds the servos that changed since the last frame of
+// the stream, the mask names them. An empty delta frame is never sent.
+
+#define FEEDBACK_MAGIC_V1 0xF1
+#define FEEDBACK_MAGIC_DELTA 0xF2
+#define FEEDBACK_HEADER_SIZE 10
+#define FEEDBACK_RECORD_SIZE 8
+#define FEEDBACK_MAX_SIZE (FEEDBACK_HEADER_SIZE + TOTAL_SERVOS * FEEDBACK_RECORD_SIZE)
+
+// Encode the servos in mask, returns the frame length
+size_t encodeFeedbackFrame(uint8_t *out, uint8_t group, uint16_t seq, uint32_t timestamp,
+                           uint16_t mask, const ServoFeedback *feedback, bool delta = false);
+
+#endif // FEEDBACK_FRAME_H
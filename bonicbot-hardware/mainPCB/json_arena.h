@@ -0,0 +1,112 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// ======================================================================
+// Fixed-buffer allocator for reusable JsonDocuments
+// ======================================================================
+// Bump allocator over a caller-provided buffer. Memory is only released by
+// reset(), so a document is cleared and the arena reset before every use.
+// Requests that do not fit fall back to the heap and are counted in
+// heapAllocs, which must stay at zero in normal operation.
+class JsonArena : public ArduinoJson::Allocator
+{
+public:
+  JsonArena(uint8_t *buffer, size_t capacity)
+      : buffer_(buffer), capacity_(capacity), used_(0), last_(nullptr),
+        heapAllocs(0), peak(0) {}
+
+  void *allocate(size_t size) override
+  {
+    size_t aligned = align(size);
+    if (used_ + HEADER + aligned > capacity_)
+    {
+      heapAllocs++;
+      return malloc(size);
+    }
+
+    uint8_t *block = buffer_ + used_;
+    *(size_t *)block = aligned;
+    used_ += HEADER + aligned;
+    if (used_ > peak)
+      peak = used_;
+    last_ = block + HEADER;
+    return last_;
+  }
+
+  void deallocate(void *ptr) override
+  {
+    if (ptr && !owns(ptr))
+      free(ptr);
+  }
+
+  void *reallocate(void *ptr, size_t newSize) override
+  {
+    if (ptr == nullptr)
+      return allocate(newSize);
+    if (!owns(ptr))
+      return realloc(ptr, newSize);
+
+    size_t *header = (size_t *)((uint8_t *)ptr - HEADER);
+    size_t aligned = align(newSize);
+
+    // The most recent block can grow or shrink in place
+    if (ptr == last_)
+    {
+      size_t start = (uint8_t *)ptr - buffer_;
+      if (start + aligned <= capacity_)
+      {
+        *header = aligned;
+        used_ = start + aligned;
+        if (used_ > peak)
+          peak = used_;
+        return ptr;
+      }
+    }
+    else if (aligned <= *header)
+    {
+      return ptr;
+    }
+
+    void *moved = allocate(newSize);
+    if (moved)
+      memcpy(moved, ptr, *header < newSize ? *header : newSize);
+    return moved;
+  }
+
+  // Release everything; only call after the owning document was cleared
+  void reset()
+  {
+    used_ = 0;
+    last_ = nullptr;
+  }
+
+  size_t used() const { return used_; }
+  size_t capacity() const { return capacity_; }
+
+private:
+  static const size_t HEADER = sizeof(size_t);
+
+  static size_t align(size_t size)
+  {
+    return (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  }
+
+  bool owns(const void *ptr) const
+  {
+    return ptr >= buffer_ && ptr < buffer_ + capacity_;
+  }
+
+  uint8_t *buffer_;
+  size_t capacity_;
+  size_t used_;
+  void *last_;
+
+public:
+  volatile uint32_t heapAllocs; // allocations that missed the arena
+  size_t peak;                  // high-water mark in bytes
+};
+
+#endif // JSON_ARENA_H
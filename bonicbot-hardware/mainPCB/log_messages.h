@@ -0,0 +1,90 @@
+// ======================================================================
+// Log Messages
+// ======================================================================
+// Every log record names one of these messages. The format strings stay
+// on the host: tools/decode_log.py reads this file, so ids are assigned
+// in the order below and existing lines must not be reordered. Add new
+// messages at the end.
+//
+// Conversions: %d (int32), %u and %x (uint32), %f and %.Nf (float), %s
+// (string, copied into the record and truncated to fit).
+//
+// Deliberately no include guard, this file is expanded with different
+// definitions of LOG_MESSAGE.
+
+LOG_MESSAGE(SUPPRESSED, "%u records of message %u suppressed")
+LOG_MESSAGE(DROPPED, "%u records dropped, log ring full")
+LOG_MESSAGE(BOOT, "Starting BonicBot firmware %s")
+LOG_MESSAGE(SETUP_COMPLETE, "Setup complete")
+LOG_MESSAGE(BONICBOT_CODE, "BONICBOT_CODE: %s")
+LOG_MESSAGE(LOOP_STATUS, "Loop running, connected=%u, parser arena misses=%u")
+LOG_MESSAGE(CONTROL_QUEUE, "Control queue: depth=%u max=%u dropped=%u latency=%uus avg=%uus max=%uus")
+LOG_MESSAGE(SUPERSEDED, "Superseded: rightHand=%u leftHand=%u head=%u base=%u")
+LOG_MESSAGE(DEVICE_CONNECTED, "Device just connected - sending welcome status")
+LOG_MESSAGE(DEVICE_DISCONNECTED, "Device just disconnected")
+LOG_MESSAGE(CENTRAL_CONNECTED, "Central connected")
+LOG_MESSAGE(CENTRAL_DISCONNECTED, "Central disconnected")
+LOG_MESSAGE(MTU_CHANGED, "MTU changed: %u")
+LOG_MESSAGE(BLE_READY, "BLE services started and advertising")
+LOG_MESSAGE(USB_LINK_READY, "USB link ready")
+LOG_MESSAGE(COMMAND_MSGPACK, "Received MessagePack command: %u bytes")
+LOG_MESSAGE(COMMAND_JSON, "Received JSON command: %u bytes")
+LOG_MESSAGE(JSON_PARSE_ERROR, "JSON parse error: %s")
+LOG_MESSAGE(ENCODING_UNSUPPORTED, "Unsupported encoding requested: %s")
+LOG_MESSAGE(ENCODING_SET, "Encoding set to %s")
+LOG_MESSAGE(COMMAND_FRAME_INVALID, "Invalid command frame")
+LOG_MESSAGE(BLE_SEND, "BLE send: %u bytes to %s, connected=%u")
+LOG_MESSAGE(FRAGMENT_TOO_LARGE, "Message too large to fragment: %u bytes")
+LOG_MESSAGE(DOCUMENT_TOO_LARGE, "Document too large")
+LOG_MESSAGE(TELEMETRY_TOO_LARGE, "Telemetry too large for %s")
+LOG_MESSAGE(STATUS_SENT, "Status sent: %s")
+LOG_MESSAGE(STREAM_STOPPED, "Stopped continuous %s data sending")
+LOG_MESSAGE(STREAMS_STOPPED, "Stopped all continuous data sending")
+LOG_MESSAGE(STREAM_NOT_CONNECTED, "Cannot start data sending: device not connected")
+LOG_MESSAGE(STREAM_UNKNOWN, "Unknown data type requested")
+LOG_MESSAGE(STREAM_STARTED, "Started continuous %s data sending with interval: %ums")
+LOG_MESSAGE(STREAM_SENT, "%s %s data sent")
+LOG_MESSAGE(TELEMETRY_TASK_STARTED, "Telemetry task started")
+LOG_MESSAGE(CONTROL_TASK_STARTED, "Control task started")
+LOG_MESSAGE(CONTROL_QUEUE_FULL, "Control queue full, command dropped")
+LOG_MESSAGE(COMMAND_LATE, "Scheduled command late by %uus, not executed")
+LOG_MESSAGE(SCHEDULE_READY, "Command schedule ready")
+LOG_MESSAGE(SCHEDULE_REJECTED, "Scheduled command rejected")
+LOG_MESSAGE(HISTORY_READY, "Telemetry history: %u samples, psram=%u")
+LOG_MESSAGE(HISTORY_ALLOC_FAILED, "Failed to allocate the telemetry history")
+LOG_MESSAGE(HISTORY_SENT, "History download sent %u samples")
+LOG_MESSAGE(NOTIFY_SLOTS_FULL, "Too many notify characteristics")
+LOG_MESSAGE(SERVO_SERIAL_READY, "Servo serial initialized")
+LOG_MESSAGE(SERVO_UPDATE_FAILED, "Failed to update servo #%u")
+LOG_MESSAGE(SERVO_UPDATED, "Updated servo #%u (%s) to angle %.2f (position %d)")
+LOG_MESSAGE(SERVO_MIDDLE, "Set servo #%u (%s) to middle position (calibration offset)")
+LOG_MESSAGE(SERVO_RELEASED, "Released servo #%u")
+LOG_MESSAGE(SERVO_GROUP_UPDATED, "Updated servo group of %u servos")
+LOG_MESSAGE(SERVO_TARGETS_UPDATED, "Updated servo targets of %u servos")
+LOG_MESSAGE(SERVO_GROUP_UNKNOWN, "Unknown group name - %s")
+LOG_MESSAGE(SERVO_GROUP_INVALID, "Invalid group specified - %s")
+LOG_MESSAGE(SERVO_SET, "Setting servo %s to angle %.2f")
+LOG_MESSAGE(SERVO_SINGLE_SET, "Setting single servo %s to angle %.2f")
+LOG_MESSAGE(SERVO_NAME_MISSING, "Invalid servo name")
+LOG_MESSAGE(SERVO_ANGLE_MISSING, "No angle specified for servo %s")
+LOG_MESSAGE(MOTORS_READY, "%s motors initialized")
+LOG_MESSAGE(MOTOR_SPEEDS, "Setting motor speeds: Left=%d, Right=%d")
+LOG_MESSAGE(BMS_READY, "BMS initialized")
+LOG_MESSAGE(EYE_BOARD_READY, "Eye board initialized")
+LOG_MESSAGE(HEAD_MODE_SET, "Head mode set to %s")
+LOG_MESSAGE(DISTANCE_TIMEOUT, "Timeout waiting for distance")
+LOG_MESSAGE(HEAD_DISTANCE, "Head distance: %d")
+LOG_MESSAGE(OTA_START, "Starting update of size: %u")
+LOG_MESSAGE(OTA_NO_SPACE, "Not enough space to begin OTA")
+LOG_MESSAGE(OTA_PROGRESS, "Written: %u/%u")
+LOG_MESSAGE(OTA_SUCCESS, "Update Success! Restarting...")
+LOG_MESSAGE(OTA_FAILED, "Update Failed!")
+LOG_MESSAGE(OTA_READY, "OTA Service initialized, firmware version %s")
+LOG_MESSAGE(FAST_STARTED, "Fast stream of servos %x: requested %ums, granted %ums, cycle %uus")
+LOG_MESSAGE(FAST_REFUSED, "Fast stream refused: %s")
+LOG_MESSAGE(FAST_DEGRADED, "Fast stream cycle %uus over budget, interval now %ums")
+LOG_MESSAGE(FAST_STOPPED, "Fast stream stopped")
+LOG_MESSAGE(SUBSCRIPTION_CHANGED, "Notifications on %s: %u")
+LOG_MESSAGE(SERVO_QUARANTINED, "Servo #%u quarantined after %u missed replies")
+LOG_MESSAGE(SERVO_READMITTED, "Servo #%u answered again after %uus, re-admitted")
+LOG_MESSAGE(SERVO_QUARANTINE_SKIPPED, "Servo #%u is quarantined, command not sent")
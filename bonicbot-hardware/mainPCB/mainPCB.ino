@@ -5,6 +5,10 @@
 #include "sensors.h"
 #include "communication.h"
 #include "ota_service.h"
+#include "control_task.h"
+#include "command_schedule.h"
+#include "fast_stream.h"
+#include "servo_bus.h"
 #include <Preferences.h>
 
 String BONICBOT_CODE = ""; // Default value, can be overwritten from NVS
@@ -12,24 +16,6 @@ String BONICBOT_CODE = ""; // Default value, can be overwritten from NVS
 // ======================================================================
 // Global Variables (defined in configs.h as extern)
 // ======================================================================
-// Servo name strings for JSON processing - Exactly matching names from robot_model.dart
-const char *SERVO_NAMES[TOTAL_SERVOS] = {
-    "rightGripper",
-    "rightWrist",
-    "rightElbow",
-    "rightSholderYaw",
-    "rightSholderRoll",
-    "rightSholderPitch",
-    "leftGripper",
-    "leftWrist",
-    "leftElbow",
-    "leftSholderYaw",
-    "leftSholderRoll",
-    "leftSholderPitch",
-    "headPan",
-    "headTilt",
-};
-
 // Servo IDs (1-14)
 byte SERVO_IDS[TOTAL_SERVOS] = {
     1, 2, 3, 4, 5, 6,    // Right hand (1-6)
@@ -92,24 +78,6 @@ HardwareSerial SerialServo(2); // UART2 for all servos
 unsigned long lastDebugPrint = 0;
 const unsigned long DEBUG_PRINT_INTERVAL = 2000; // 2 seconds
 
-// ======================================================================
-// Serial command processing (for SERIAL or BOTH communication modes)
-// ======================================================================
-void checkSerialCommands()
-{
-#if COMM_METHOD == COMM_METHOD_SERIAL || COMM_METHOD == COMM_METHOD_BOTH
-  if (Serial.available())
-  {
-    String command = Serial.readStringUntil('\n');
-    command.trim();
-    if (command.length() > 0)
-    {
-      processCommand(command);
-    }
-  }
-#endif
-}
-
 // ======================================================================
 // Setup Function
 // ======================================================================
@@ -133,16 +101,23 @@ void setup()
   // Initialize communication first for debug output
   initializeCommunication();
 
-  Serial.println("Starting BonicBot firmware...");
+  LOG_INFO(BOOT, FIRMWARE_VERSION);
 
   // Initialize subsystems
   initializeServos(SerialServo);
+  initializeServoBus();
   initializeMotors(SerialMOTOR);
   initializeSensors(SerialBMS);
 
-  Serial.println("Setup complete!");
-  Serial.print("BONICBOT_CODE: ");
-  Serial.println(BONICBOT_CODE);
+  // Commands are executed off the BLE callback task from here on
+  initializeControlTask();
+  initializeCommandSchedule();
+  initializeHistory();
+  initializeTelemetry();
+  initializeFastStream();
+
+  LOG_INFO(SETUP_COMPLETE);
+  LOG_INFO(BONICBOT_CODE, BONICBOT_CODE.c_str());
 }
 
 // ======================================================================
@@ -156,25 +131,26 @@ void loop()
   if (now - lastDebugPrint >= DEBUG_PRINT_INTERVAL)
   {
     lastDebugPrint = now;
-    if (DEBUG)
-    {
-      Serial.print("Loop running at millis(): ");
-      Serial.println(now);
-      Serial.print("Connection status: ");
-      Serial.println(deviceConnected ? "Connected" : "Disconnected");
-    }
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    LOG_DEBUG(LOOP_STATUS, deviceConnected, getCommandArenaMisses());
+
+    ControlTaskStats stats;
+    getControlTaskStats(stats);
+    LOG_DEBUG(CONTROL_QUEUE, stats.depth, stats.maxDepth, stats.dropped,
+              stats.lastLatencyUs, stats.avgLatencyUs, stats.maxLatencyUs);
+    LOG_DEBUG(SUPERSEDED, stats.servoSuperseded[DATA_RIGHT_HAND],
+              stats.servoSuperseded[DATA_LEFT_HAND], stats.servoSuperseded[DATA_HEAD],
+              stats.baseSuperseded);
+#endif
   }
 
-  // Check for serial commands (if using serial communication)
-  checkSerialCommands();
-
   // Handling connecting and disconnecting events for BLE
 #if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
   if (deviceConnected && !oldDeviceConnected)
   {
     // Just connected
     oldDeviceConnected = deviceConnected;
-    Serial.println("Device just connected - sending welcome status");
+    LOG_INFO(DEVICE_CONNECTED);
 
     // Send a welcome status message
     sendStatus("connected");
@@ -184,7 +160,7 @@ void loop()
   {
     // Just disconnected
     oldDeviceConnected = deviceConnected;
-    Serial.println("Device just disconnected");
+    LOG_INFO(DEVICE_DISCONNECTED);
     delay(500); // Give BLE stack time to get ready for new connections
   }
 #endif
@@ -1,4 +1,5 @@
 #include "motor_control.h"
+#include "debug_log.h"
 
 // Global motor control instances
 #if MOTOR_TYPE == MOTOR_TYPE_CYTRON
@@ -15,16 +16,14 @@ void initializeMotors(HardwareSerial &motorSerial)
   // Cytron motors just need to be set to zero initially
   leftMotor.setSpeed(0);
   rightMotor.setSpeed(0);
-  if (DEBUG)
-    Serial.println("Cytron motors initialized");
+  LOG_INFO(MOTORS_READY, "Cytron");
 #elif MOTOR_TYPE == MOTOR_TYPE_DDSM
   // DDSM motors require serial communication
   motorSerial.begin(DDSM_BAUDRATE, SERIAL_8N1, MOTOR_RX, MOTOR_TX);
   dc.pSerial = &motorSerial;
   dc.set_ddsm_type(115);
   dc.clear_ddsm_buffer();
-  if (DEBUG)
-    Serial.println("DDSM motors initialized");
+  LOG_INFO(MOTORS_READY, "DDSM");
 #endif
 }
 
@@ -35,13 +34,7 @@ void setMotorSpeeds(int leftSpeed, int rightSpeed)
   leftSpeed = constrain(leftSpeed, -255, 255);
   rightSpeed = constrain(rightSpeed, -255, 255);
 
-  if (DEBUG)
-  {
-    Serial.print("Setting motor speeds: Left=");
-    Serial.print(leftSpeed);
-    Serial.print(", Right=");
-    Serial.println(rightSpeed);
-  }
+  LOG_DEBUG(MOTOR_SPEEDS, leftSpeed, rightSpeed);
 
 #if MOTOR_TYPE == MOTOR_TYPE_CYTRON
   // Use Cytron motor controller
@@ -58,8 +51,8 @@ void setMotorSpeeds(int leftSpeed, int rightSpeed)
 bool readBaseMotorData(JsonObject &base)
 {
   // Create left and right motor objects to match Dart's BaseModel
-  JsonObject leftMotor = base.createNestedObject("leftMotor");
-  JsonObject rightMotor = base.createNestedObject("rightMotor");
+  JsonObject leftMotor = base["leftMotor"].to<JsonObject>();
+  JsonObject rightMotor = base["rightMotor"].to<JsonObject>();
 
   leftMotor["id"] = "left";
   leftMotor["minSpeed"] = -255;
@@ -87,32 +80,23 @@ bool readBaseMotorData(JsonObject &base)
   return true;
 }
 
-// Process motor commands from JSON - Expecting Dart's BaseModel format
-void processMotorCommands(JsonObject base)
+// Parse motor commands from JSON - Expecting Dart's BaseModel format
+void parseMotorCommands(JsonObject base, int &leftSpeed, int &rightSpeed)
 {
-  int leftSpeed = 0;
-  int rightSpeed = 0;
+  leftSpeed = 0;
+  rightSpeed = 0;
 
   // Check for left motor - using naming from Dart's BaseModel
-  if (base.containsKey("leftMotor"))
+  JsonVariant leftMotorSpeed = base["leftMotor"]["speed"];
+  if (!leftMotorSpeed.isNull())
   {
-    JsonObject leftMotorObj = base["leftMotor"];
-    if (leftMotorObj.containsKey("speed"))
-    {
-      leftSpeed = leftMotorObj["speed"];
-    }
+    leftSpeed = leftMotorSpeed;
   }
 
   // Check for right motor - using naming from Dart's BaseModel
-  if (base.containsKey("rightMotor"))
+  JsonVariant rightMotorSpeed = base["rightMotor"]["speed"];
+  if (!rightMotorSpeed.isNull())
   {
-    JsonObject rightMotorObj = base["rightMotor"];
-    if (rightMotorObj.containsKey("speed"))
-    {
-      rightSpeed = rightMotorObj["speed"];
-    }
+    rightSpeed = rightMotorSpeed;
   }
-
-  // Apply motor commands
-  setMotorSpeeds(leftSpeed, rightSpeed);
 }
\ No newline at end of file
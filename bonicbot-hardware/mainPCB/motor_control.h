@@ -16,7 +16,7 @@ void setMotorSpeeds(int motor1Speed, int motor2Speed);
 // Read motor status into JSON object
 bool readBaseMotorData(JsonObject &motors);
 
-// Process motor commands from JSON
-void processMotorCommands(JsonObject motors);
+// Parse motor commands from JSON
+void parseMotorCommands(JsonObject motors, int &leftSpeed, int &rightSpeed);
 
 #endif // MOTOR_CONTROL_H
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "notify_sender.h"
+#include "debug_log.h"
+
+// Largest notification payload at the preferred MTU
+#define NOTIFY_MAX_PAYLOAD (BLE_PREFERRED_MTU - 3)
+
+struct NotifySlot
+{
+  BLECharacteristic *characteristic;
+  bool mergeable;
+  bool inFlight;
+  uint32_t sentAt; // millis() of the in-flight notify
+  bool hasPending;
+  uint8_t pendingBuffer; // buffer the pending frame is written to
+  uint16_t pendingLen;
+  uint8_t buffers[2][NOTIFY_MAX_PAYLOAD]; // the other one may be sending
+  NotifyStats stats;
+};
+
+static portMUX_TYPE notifyLock = portMUX_INITIALIZER_UNLOCKED;
+static NotifySlot slots[NOTIFY_MAX_CHARACTERISTICS];
+static int slotCount = 0;
+static bool congested = false;
+
+static NotifySlot *findSlot(BLECharacteristic *characteristic)
+{
+  for (int i = 0; i < slotCount; i++)
+  {
+    if (slots[i].characteristic == characteristic)
+      return &slots[i];
+  }
+  return nullptr;
+}
+
+static NotifySlot *findSlotByHandle(uint16_t handle)
+{
+  for (int i = 0; i < slotCount; i++)
+  {
+    if (slots[i].characteristic->getHandle() == handle)
+      return &slots[i];
+  }
+  return nullptr;
+}
+
+// Errors are reported from inside notify(), no CONF_EVT follows them
+class NotifyStatusCallbacks : public BLECharacteristicCallbacks
+{
+  void onStatus(BLECharacteristic *characteristic, Status status, uint32_t code) override
+  {
+    if (status == SUCCESS_NOTIFY || status == SUCCESS_INDICATE)
+      return;
+
+    NotifySlot *slot = findSlot(characteristic);
+    if (slot == nullptr)
+      return;
+
+    portENTER_CRITICAL(&notifyLock);
+    slot->stats.failed++;
+    slot->inFlight = false;
+    portEXIT_CRITICAL(&notifyLock);
+  }
+};
+
+static NotifyStatusCallbacks statusCallbacks;
+
+static void transmit(NotifySlot &slot, const uint8_t *data, size_t len)
+{
+  slot.characteristic->setValue((uint8_t *)data, len);
+  slot.characteristic->notify();
+}
+
+// Send the pending frame of a slot once it is free
+static void flushPending(NotifySlot &slot)
+{
+  portENTER_CRITICAL(&notifyLock);
+  bool send = slot.hasPending && !slot.inFlight && !congested;
+  uint8_t buffer = slot.pendingBuffer;
+  uint16_t len = slot.pendingLen;
+  if (send)
+  {
+    slot.hasPending = false;
+    slot.pendingBuffer ^= 1;
+    slot.inFlight = true;
+    slot.sentAt = millis();
+  }
+  portEXIT_CRITICAL(&notifyLock);
+
+  if (send)
+    transmit(slot, slot.buffers[buffer], len);
+}
+
+// Track a notify characteristic, call once per characteristic at setup
+void registerNotifyCharacteristic(BLECharacteristic *characteristic, const char *name, bool mergeable)
+{
+  if (slotCount >= NOTIFY_MAX_CHARACTERISTICS)
+  {
+    LOG_ERROR(NOTIFY_SLOTS_FULL);
+    return;
+  }
+
+  NotifySlot &slot = slots[slotCount++];
+  slot.characteristic = characteristic;
+  slot.mergeable = mergeable;
+  slot.stats.name = name;
+  characteristic->setCallbacks(&statusCallbacks);
+}
+
+// Notify a frame, or hold it as the pending frame of a busy characteristic
+void notifySend(BLECharacteristic *characteristic, const uint8_t *data, size_t len)
+{
+  NotifySlot *slot = findSlot(characteristic);
+  if (slot == nullptr)
+  {
+    characteristic->setValue((uint8_t *)data, len);
+    characteristic->notify();
+    return;
+  }
+
+  uint32_t now = millis();
+
+  portENTER_CRITICAL(&notifyLock);
+  if (slot->inFlight && now - slot->sentAt > NOTIFY_INFLIGHT_TIMEOUT_MS)
+  {
+    // The stack never reported it
+    slot->stats.failed++;
+    slot->inFlight = false;
+  }
+
+  bool hold = slot->mergeable && (slot->inFlight || congested);
+  if (slot->hasPending)
+    slot->stats.merged++;
+
+  if (hold)
+  {
+    size_t pendingLen = min(len, (size_t)NOTIFY_MAX_PAYLOAD);
+    memcpy(slot->buffers[slot->pendingBuffer], data, pendingLen);
+    slot->pendingLen = pendingLen;
+    slot->hasPending = true;
+  }
+  else
+  {
+    slot->hasPending = false;
+    slot->inFlight = true;
+    slot->sentAt = now;
+  }
+  portEXIT_CRITICAL(&notifyLock);
+
+  if (!hold)
+    transmit(*slot, data, len);
+}
+
+// Wait until the stack reported the last notification of a characteristic
+bool waitNotifyIdle(BLECharacteristic *characteristic, uint32_t timeoutMs)
+{
+  NotifySlot *slot = findSlot(characteristic);
+  if (slot == nullptr)
+    return true;
+
+  uint32_t start = millis();
+  for (;;)
+  {
+    portENTER_CRITICAL(&notifyLock);
+    bool inFlight = slot->inFlight;
+    portEXIT_CRITICAL(&notifyLock);
+
+    if (!inFlight)
+      return true;
+    if (millis() - start >= timeoutMs)
+      return false;
+    vTaskDelay(1);
+  }
+}
+
+// GATTS events, for BLEDevice::setCustomGattsHandler
+void notifyGattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf, esp_ble_gatts_cb_param_t *param)
+{
+  switch (event)
+  {
+  case ESP_GATTS_CONF_EVT:
+  {
+    NotifySlot *slot = findSlotByHandle(param->conf.handle);
+    if (slot == nullptr)
+      return;
+
+    portENTER_CRITICAL(&notifyLock);
+    if (param->conf.status == ESP_GATT_OK)
+      slot->stats.sent++;
+    else
+      slot->stats.failed++;
+    slot->inFlight = false;
+    portEXIT_CRITICAL(&notifyLock);
+
+    flushPending(*slot);
+    break;
+  }
+
+  case ESP_GATTS_CONGEST_EVT:
+    portENTER_CRITICAL(&notifyLock);
+    congested = param->congest.congested;
+    portEXIT_CRITICAL(&notifyLock);
+
+    if (!param->congest.congested)
+    {
+      for (int i = 0; i < slotCount; i++)
+        flushPending(slots[i]);
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+// Forget in-flight and pending frames, on connect and disconnect
+void resetNotifySender()
+{
+  portENTER_CRITICAL(&notifyLock);
+  congested = false;
+  for (int i = 0; i < slotCount; i++)
+  {
+    slots[i].inFlight = false;
+    slots[i].hasPending = false;
+  }
+  portEXIT_CRITICAL(&notifyLock);
+}
+
+// Counters of the registered characteristics, returns how many were filled
+int getNotifyStats(NotifyStats *stats, int maxStats)
+{
+  int count = min(slotCount, maxStats);
+
+  portENTER_CRITICAL(&notifyLock);
+  for (int i = 0; i < count; i++)
+    stats[i] = slots[i].stats;
+  portEXIT_CRITICAL(&notifyLock);
+
+  return count;
+}
@@ -0,0 +1,54 @@
+#ifndef NOTIFY_SENDER_H
+#define NOTIFY_SENDER_H
+
+#include <Arduino.h>
+#include <BLECharacteristic.h>
+#include <esp_gatts_api.h>
+#include "configs.h"
+
+// ======================================================================
+// Notification Sender
+// ======================================================================
+// Every BLE notification goes through notifySend. A notification is in
+// flight from notify() until the stack reports it with ESP_GATTS_CONF_EVT,
+// and the whole link is held while the stack reports L2CAP congestion
+// (ESP_GATTS_CONGEST_EVT).
+//
+// On a mergeable characteristic a frame that arrives while the previous
+// one is in flight, or while the link is congested, becomes the pending
+// frame and replaces any older pending frame, so a slow link sends the
+// newest telemetry instead of a backlog. The pending frame goes out as
+// soon as the in-flight one completes or congestion clears.
+//
+// Acks and fragmented messages lose meaning when frames are dropped, so
+// their characteristics are registered as not mergeable and every frame
+// is handed to the stack as before.
+
+struct NotifyStats
+{
+  const char *name;
+  uint32_t sent;   // notifications the stack reported sent
+  uint32_t merged; // pending frames replaced by a newer one
+  uint32_t failed; // rejected by the stack or never reported
+};
+
+// Track a notify characteristic, call once per characteristic at setup
+void registerNotifyCharacteristic(BLECharacteristic *characteristic, const char *name, bool mergeable);
+
+// Notify a frame, or hold it as the pending frame of a busy characteristic
+void notifySend(BLECharacteristic *characteristic, const uint8_t *data, size_t len);
+
+// Wait until the stack reported the last notification of a
+// characteristic, false on timeout
+bool waitNotifyIdle(BLECharacteristic *characteristic, uint32_t timeoutMs);
+
+// GATTS events, for BLEDevice::setCustomGattsHandler
+void notifyGattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf, esp_ble_gatts_cb_param_t *param);
+
+// Forget in-flight and pending frames, on connect and disconnect
+void resetNotifySender();
+
+// Counters of the registered characteristics, returns how many were filled
+int getNotifyStats(NotifyStats *stats, int maxStats);
+
+#endif // NOTIFY_SENDER_H
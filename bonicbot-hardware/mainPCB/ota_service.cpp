@@ -1,5 +1,6 @@
 #include "ota_service.h"
 #include "configs.h"
+#include "debug_log.h"
 
 BLEService* otaService = nullptr;
 BLECharacteristic* otaCharacteristic = nullptr;
@@ -20,14 +21,10 @@ class OTACallbacks: public BLECharacteristicCallbacks {
             
             if (!error) {
                 updateSize = doc["size"];
-                if (DEBUG) {
-                    Serial.printf("Starting update of size: %d\n", updateSize);
-                }
+                LOG_INFO(OTA_START, updateSize);
                 
                 if (!Update.begin(updateSize)) {
-                    if (DEBUG) {
-                        Serial.println("Not enough space to begin OTA");
-                    }
+                    LOG_ERROR(OTA_NO_SPACE);
                     return;
                 }
                 
@@ -40,21 +37,15 @@ class OTACallbacks: public BLECharacteristicCallbacks {
             Update.write((uint8_t*)value.c_str(), chunk_size);
             writtenSize += chunk_size;
             
-            if (DEBUG) {
-                Serial.printf("Written: %d/%d\n", writtenSize, updateSize);
-            }
+            LOG_DEBUG(OTA_PROGRESS, writtenSize, updateSize);
             
             if (writtenSize >= updateSize) {
                 if (Update.end(true)) {
-                    if (DEBUG) {
-                        Serial.println("Update Success! Restarting...");
-                    }
+                    LOG_INFO(OTA_SUCCESS);
                     delay(1000);
                     ESP.restart();
                 } else {
-                    if (DEBUG) {
-                        Serial.println("Update Failed!");
-                    }
+                    LOG_ERROR(OTA_FAILED);
                 }
                 updateInProgress = false;
             }
@@ -83,8 +74,5 @@ void initializeOTAService(BLEServer* server) {
     // Start the service
     otaService->start();
     
-    if (DEBUG) {
-        Serial.println("OTA Service initialized");
-        Serial.printf("Current firmware version: %s\n", FIRMWARE_VERSION);
-    }
+    LOG_INFO(OTA_READY, FIRMWARE_VERSION);
 } 
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "protocol.h"
+#include "token_hash.h"
+
+static constexpr const char *DATA_TYPE_NAMES[] = {
+    RIGHT_HAND_GROUP,
+    LEFT_HAND_GROUP,
+    HEAD_GROUP,
+    BATTERY,
+    BASE,
+    DISTANCE,
+    SERVO,
+    BODY,
+    DIAGNOSTICS,
+    STATE,
+    HISTORY,
+    FAST,
+};
+
+static constexpr const char *COMMAND_TYPE_NAMES[] = {
+    "command",
+    "receiveSingle",
+    "receiveContinuous",
+    "stopReceive",
+    "hello",
+};
+
+static constexpr const char *ENCODING_NAMES[] = {
+    "json",
+    "msgpack",
+};
+
+static constexpr const char *FORMAT_NAMES[] = {
+    "document",
+    "packed",
+};
+
+static constexpr TokenTable<sizeof(DATA_TYPE_NAMES) / sizeof(DATA_TYPE_NAMES[0]), 16> DATA_TYPE_TABLE(DATA_TYPE_NAMES);
+static constexpr TokenTable<sizeof(COMMAND_TYPE_NAMES) / sizeof(COMMAND_TYPE_NAMES[0]), 8> COMMAND_TYPE_TABLE(COMMAND_TYPE_NAMES);
+
+static constexpr TokenTable<sizeof(ENCODING_NAMES) / sizeof(ENCODING_NAMES[0]), 4> ENCODING_TABLE(ENCODING_NAMES);
+static constexpr TokenTable<sizeof(FORMAT_NAMES) / sizeof(FORMAT_NAMES[0]), 4> FORMAT_TABLE(FORMAT_NAMES);
+
+static_assert(DATA_TYPE_TABLE.valid(), "no perfect hash for data types");
+static_assert(COMMAND_TYPE_TABLE.valid(), "no perfect hash for command types");
+static_assert(ENCODING_TABLE.valid(), "no perfect hash for encodings");
+static_assert(FORMAT_TABLE.valid(), "no perfect hash for telemetry formats");
+
+DataType parseDataType(const char *token)
+{
+  return (DataType)DATA_TYPE_TABLE.find(token);
+}
+
+CommandType parseCommandType(const char *token)
+{
+  return (CommandType)COMMAND_TYPE_TABLE.find(token);
+}
+
+bool parseEncoding(const char *token, Encoding &encoding)
+{
+  int index = ENCODING_TABLE.find(token);
+  if (index < 0)
+    return false;
+  encoding = (Encoding)index;
+  return true;
+}
+
+TelemetryFormat parseTelemetryFormat(const char *token)
+{
+  int index = FORMAT_TABLE.find(token);
+  return index < 0 ? FORMAT_DOCUMENT : (TelemetryFormat)index;
+}
+
+const char *encodingName(Encoding encoding)
+{
+  return ENCODING_NAMES[encoding == ENCODING_MSGPACK ? ENCODING_MSGPACK : ENCODING_JSON];
+}
+
+const char *dataTypeName(DataType type)
+{
+  if (type < 0 || type >= (int)(sizeof(DATA_TYPE_NAMES) / sizeof(DATA_TYPE_NAMES[0])))
+    return "unknown";
+  return DATA_TYPE_NAMES[type];
+}
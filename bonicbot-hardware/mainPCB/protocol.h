@@ -0,0 +1,80 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <Arduino.h>
+#include "configs.h"
+
+// ======================================================================
+// Protocol tokens
+// ======================================================================
+// Enum ids for the "dataType" and "commandType" strings so the command
+// path can dispatch without building or comparing String objects.
+
+enum DataType
+{
+  DATA_UNKNOWN = -1,
+  DATA_RIGHT_HAND = 0,
+  DATA_LEFT_HAND,
+  DATA_HEAD,
+  DATA_BATTERY,
+  DATA_BASE,
+  DATA_DISTANCE,
+  DATA_SERVO,
+  DATA_BODY,
+  DATA_DIAGNOSTICS,
+  DATA_STATE,
+  DATA_HISTORY,
+  DATA_FAST,
+};
+
+enum CommandType
+{
+  COMMAND_UNKNOWN = -1,
+  COMMAND_COMMAND = 0,
+  COMMAND_RECEIVE_SINGLE,
+  COMMAND_RECEIVE_CONTINUOUS,
+  COMMAND_STOP_RECEIVE,
+  COMMAND_HELLO,
+};
+
+// Payload encoding negotiated with the "hello" command
+enum Encoding : uint8_t
+{
+  ENCODING_JSON = 0,
+  ENCODING_MSGPACK,
+};
+
+// Telemetry format of a subscription ("format" of a receive command)
+enum TelemetryFormat : uint8_t
+{
+  FORMAT_DOCUMENT = 0, // JSON or MessagePack, as negotiated
+  FORMAT_PACKED,       // packed binary frame (feedback_frame.h)
+};
+
+// Map a token to its id, unknown or null tokens give *_UNKNOWN
+DataType parseDataType(const char *token);
+CommandType parseCommandType(const char *token);
+
+// Map an encoding token, returns false for unknown tokens
+bool parseEncoding(const char *token, Encoding &encoding);
+const char *encodingName(Encoding encoding);
+
+// Map a format token, unknown or null tokens give FORMAT_DOCUMENT
+TelemetryFormat parseTelemetryFormat(const char *token);
+
+// MessagePack commands are maps, JSON commands start with '{'
+inline bool isMsgPackMap(const uint8_t *data, size_t len)
+{
+  return len > 0 && ((data[0] & 0xF0) == 0x80 || data[0] == 0xDE || data[0] == 0xDF);
+}
+
+// Token string for a data type
+const char *dataTypeName(DataType type);
+
+// Servo groups share the first data type ids
+inline bool isServoGroup(DataType type)
+{
+  return type == DATA_RIGHT_HAND || type == DATA_LEFT_HAND || type == DATA_HEAD;
+}
+
+#endif // PROTOCOL_H
@@ -1,4 +1,5 @@
 #include "sensors.h"
+#include "debug_log.h"
 #include <SoftwareSerial.h>
 
 // Global sensor instances
@@ -15,30 +16,29 @@ void initializeSensors(HardwareSerial &bmsSerial)
   bmsSerial.begin(9600, SERIAL_8N1, BMS_RXD, BMS_TXD);
   bms = new Daly_BMS_UART(bmsSerial);
   bms->Init();
-  if (DEBUG)
-    Serial.println("BMS initialized");
+  LOG_INFO(BMS_READY);
 
   // Initialize head board serial
   headSerial.begin(9600);
 
-  if (DEBUG)
-    Serial.println("Eye board initialized");
+  LOG_INFO(EYE_BOARD_READY);
 }
 
 // Set head board mode (Happy, Sad)
-bool setHeadMode(String mode)
+bool setHeadMode(const char *mode)
 {
+  if (mode == nullptr)
+  {
+    return false;
+  }
+
   // Send the mode command as a string
   headSerial.println(mode);
 
   // Store current mode
   // currentHeadMode = mode;
 
-  if (DEBUG)
-  {
-    Serial.print("Head mode set to ");
-    Serial.println(mode);
-  }
+  LOG_DEBUG(HEAD_MODE_SET, mode);
 
   return true;
 }
@@ -68,8 +68,7 @@ int getHeadDistance()
   {
     if (millis() - startTime > 500)
     {
-      if (DEBUG)
-        Serial.println("Timeout waiting for distance");
+      LOG_WARN(DISTANCE_TIMEOUT);
       return -1;
     }
     delay(10);
@@ -83,11 +82,7 @@ int getHeadDistance()
   lastDistanceReading = distance;
   lastDistanceReadTime = now;
 
-  if (DEBUG)
-  {
-    Serial.print("Head distance: ");
-    Serial.println(distance);
-  }
+  LOG_DEBUG(HEAD_DISTANCE, distance);
 
   return distance;
 }
@@ -119,6 +114,12 @@ bool readBmsData(JsonObject &battery)
   return success;
 }
 
+// Pack current in A from the last BMS reading, 0 without a BMS
+float getBatteryCurrent()
+{
+  return bms == nullptr ? 0 : bms->get.packCurrent;
+}
+
 bool readDistanceData(JsonObject &distance)
 {
   int value = getHeadDistance();
@@ -10,7 +10,7 @@
 void initializeSensors(HardwareSerial &bmsSerial);
 
 // Set head board mode ("Happy", "Sad")
-bool setHeadMode(String mode);
+bool setHeadMode(const char *mode);
 
 // Get distance reading from eye board (sends command 3)
 int getHeadDistance();
@@ -20,6 +20,9 @@ bool readBmsData(JsonObject &battery);
 
 bool readDistanceData(JsonObject &distance);
 
+// Pack current in A from the last BMS reading, 0 without a BMS
+float getBatteryCurrent();
+
 // Read eye board data into JSON object
 // bool readHeadData(JsonObject &head);
 
@@ -0,0 +1,121 @@
+#include "servo_bus.h"
+
+static QueueHandle_t busQueue = nullptr;
+static portMUX_TYPE busStatsLock = portMUX_INITIALIZER_UNLOCKED;
+static ServoBusStats stats = {};
+
+static void runTransaction(ServoTransaction &transaction)
+{
+  switch (transaction.kind)
+  {
+  case SERVO_TRANSACTION_TARGETS:
+    updateServoTargets(transaction.targets);
+    break;
+  case SERVO_TRANSACTION_FEEDBACK:
+    transaction.answered = readServoFeedbackWithin(transaction.mask, transaction.feedback,
+                                                   transaction.ioTimeoutUs);
+    break;
+  }
+}
+
+static void servoBusTask(void *param)
+{
+  ServoTransaction *transaction;
+
+  for (;;)
+  {
+    xQueueReceive(busQueue, &transaction, portMAX_DELAY);
+
+    uint32_t start = micros();
+    runTransaction(*transaction);
+    uint32_t elapsed = micros() - start;
+    transaction->startedAt = start;
+    transaction->busyUs = elapsed;
+
+    if (transaction->done != nullptr)
+      transaction->done(*transaction);
+    transaction->complete = true;
+    xSemaphoreGive(transaction->doneSignal);
+
+    portENTER_CRITICAL(&busStatsLock);
+    stats.completed++;
+    stats.busyUs += elapsed;
+    if (transaction->kind == SERVO_TRANSACTION_TARGETS)
+      stats.targetsBusyUs += elapsed;
+    portEXIT_CRITICAL(&busStatsLock);
+  }
+}
+
+// Create the queue and start the bus task
+void initializeServoBus()
+{
+  busQueue = xQueueCreate(SERVO_BUS_QUEUE_LENGTH, sizeof(ServoTransaction *));
+  xTaskCreatePinnedToCore(servoBusTask, "servoBus", SERVO_BUS_TASK_STACK, nullptr,
+                          SERVO_BUS_TASK_PRIORITY, nullptr, SERVO_BUS_TASK_CORE);
+}
+
+// Prepare a transaction for use, once before its first submit
+void initServoTransaction(ServoTransaction &transaction, ServoTransactionKind kind)
+{
+  memset(&transaction, 0, sizeof(transaction));
+  transaction.kind = kind;
+  transaction.ioTimeoutUs = SERVO_REPLY_TIMEOUT_US;
+  transaction.complete = true;
+  transaction.doneSignal = xSemaphoreCreateBinaryStatic(&transaction.doneSignalBuffer);
+}
+
+// Queue a transaction, waiting up to ticks for room behind the queued ones,
+// false if the queue stayed full
+bool submitServoTransaction(ServoTransaction &transaction, TickType_t ticks)
+{
+  if (busQueue == nullptr)
+    return false;
+
+  // Drop a completion nobody waited for
+  xSemaphoreTake(transaction.doneSignal, 0);
+  transaction.complete = false;
+
+  ServoTransaction *pointer = &transaction;
+  bool queued = xQueueSend(busQueue, &pointer, ticks) == pdTRUE;
+  if (!queued)
+    transaction.complete = true;
+
+  uint32_t depth = uxQueueMessagesWaiting(busQueue);
+  portENTER_CRITICAL(&busStatsLock);
+  if (queued)
+    stats.submitted++;
+  else
+    stats.rejected++;
+  if (depth > stats.maxDepth)
+    stats.maxDepth = depth;
+  portEXIT_CRITICAL(&busStatsLock);
+
+  return queued;
+}
+
+bool servoTransactionDone(const ServoTransaction &transaction)
+{
+  return transaction.complete;
+}
+
+// Block until the transaction is done, false on timeout
+bool waitServoTransaction(ServoTransaction &transaction, TickType_t ticks)
+{
+  // A signal left from an earlier submit only ends one round
+  while (!transaction.complete)
+  {
+    if (xSemaphoreTake(transaction.doneSignal, ticks) != pdTRUE)
+      return transaction.complete;
+  }
+  return true;
+}
+
+void getServoBusStats(ServoBusStats &out)
+{
+  uint32_t depth = busQueue != nullptr ? uxQueueMessagesWaiting(busQueue) : 0;
+
+  portENTER_CRITICAL(&busStatsLock);
+  out = stats;
+  out.depth = depth;
+  portEXIT_CRITICAL(&busStatsLock);
+}
@@ -0,0 +1,79 @@
+#ifndef SERVO_BUS_H
+#define SERVO_BUS_H
+
+#include <Arduino.h>
+#include "configs.h"
+#include "servo_control.h"
+
+// ======================================================================
+// Servo Bus Driver
+// ======================================================================
+// Non-blocking servo transactions. The caller fills a ServoTransaction,
+// submits it and carries on, or waits for room when the queue is full. A bus task runs the queued transactions in
+// order, back to back. When one completes, its done callback runs on the
+// bus task and its waiter is released. Callers poll
+// servoTransactionDone or block in waitServoTransaction.
+//
+// A sync write gets no reply, so the task does not wait for it to leave
+// the UART. The frame of the next transaction queues right behind it,
+// and a sync read goes out on the wire with no gap after the write.
+//
+// A transaction belongs to the bus task from submit until it is done and
+// must not be touched in between. Transactions are meant to live as long
+// as the caller, static or in a module, and to be reused. The blocking
+// calls in servo_control.h stay available, both paths share the bus lock.
+
+enum ServoTransactionKind : uint8_t
+{
+  SERVO_TRANSACTION_TARGETS,  // updateServoTargets
+  SERVO_TRANSACTION_FEEDBACK, // readServoFeedbackWithin
+};
+
+struct ServoTransaction
+{
+  ServoTransactionKind kind;
+  ServoTargets targets;                 // TARGETS: servos to move
+  uint16_t mask;                        // FEEDBACK: servos to read
+  uint32_t ioTimeoutUs;                 // FEEDBACK: longest reply wait per servo
+  ServoFeedback feedback[TOTAL_SERVOS]; // FEEDBACK result, by servo index
+  int answered;                         // FEEDBACK result, servos that answered
+  uint32_t startedAt;                   // micros() when the bus task started it
+  uint32_t busyUs;                      // time the bus task spent on it
+  void (*done)(ServoTransaction &transaction); // on the bus task, may be null
+  void *context;                        // for the callback
+
+  // Owned by the bus driver
+  volatile bool complete;
+  SemaphoreHandle_t doneSignal;
+  StaticSemaphore_t doneSignalBuffer;
+};
+
+struct ServoBusStats
+{
+  uint32_t submitted;
+  uint32_t completed;
+  uint32_t rejected; // queue full
+  uint32_t depth;    // transactions waiting
+  uint32_t maxDepth;
+  uint32_t busyUs;   // time spent running transactions
+  uint32_t targetsBusyUs; // of which running servo writes
+};
+
+// Create the queue and start the bus task
+void initializeServoBus();
+
+// Prepare a transaction for use, once before its first submit
+void initServoTransaction(ServoTransaction &transaction, ServoTransactionKind kind);
+
+// Queue a transaction, waiting up to ticks for room behind the queued ones,
+// false if the queue stayed full
+bool submitServoTransaction(ServoTransaction &transaction, TickType_t ticks = 0);
+
+bool servoTransactionDone(const ServoTransaction &transaction);
+
+// Block until the transaction is done, false on timeout
+bool waitServoTransaction(ServoTransaction &transaction, TickType_t ticks = portMAX_DELAY);
+
+void getServoBusStats(ServoBusStats &stats);
+
+#endif // SERVO_BUS_H
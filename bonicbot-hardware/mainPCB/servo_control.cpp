@@ -1,15 +1,58 @@
 #include "servo_control.h"
+#include "servo_health.h"
+#include "token_hash.h"
+#include "debug_log.h"
 
 // Global servo controller instance
 SMS_STS st;
 
+// The control task writes and the telemetry task reads on the same bus
+static SemaphoreHandle_t busLock = nullptr;
+
+static void lockBus()
+{
+  xSemaphoreTake(busLock, portMAX_DELAY);
+}
+
+static void unlockBus()
+{
+  xSemaphoreGive(busLock);
+}
+
+// Acked commands to a quarantined servo are not sent
+static bool skipQuarantined(int servoIndex)
+{
+  if (!(quarantinedServos() & (1 << servoIndex)))
+    return false;
+
+  LOG_WARN(SERVO_QUARANTINE_SKIPPED, SERVO_IDS[servoIndex]);
+  return true;
+}
+
+// Give one servo its own reply timeout, the bus must be locked
+static void beginServoReply(int servoIndex)
+{
+  st.IOTimeOutUs = servoTimeoutUs(servoIndex);
+}
+
+// Record whether the servo answered and restore the default timeout
+static void endServoReply(int servoIndex, bool answered)
+{
+  st.IOTimeOutUs = SERVO_REPLY_TIMEOUT_US;
+  if (answered)
+    recordServoReply(servoIndex, st.ReplyUs);
+  else
+    recordServoMiss(servoIndex);
+}
+
 // Initialize servo system
 void initializeServos(HardwareSerial &servoSerial)
 {
-  servoSerial.begin(1000000, SERIAL_8N1, SERVOS_RXD, SERVOS_TXD);
-  st.pSerial = &servoSerial;
-  if (DEBUG)
-    Serial.println("Servo serial initialized");
+  busLock = xSemaphoreCreateMutex();
+  servoSerial.begin(SERVOS_BAUD, SERIAL_8N1, SERVOS_RXD, SERVOS_TXD);
+  st.begin(&servoSerial, SERVOS_BAUD);
+  st.IOTimeOutUs = SERVO_REPLY_TIMEOUT_US;
+  LOG_INFO(SERVO_SERIAL_READY);
 }
 
 // Helper function to get the angle limits for a specific servo
@@ -81,33 +124,56 @@ void getAngleLimits(int servoIndex, float &minAngle, float &maxAngle)
 }
 
 // Get which body part group a servo belongs to
-String getServoGroup(int servoIndex)
+DataType getServoGroup(int servoIndex)
 {
   if (servoIndex >= RIGHT_GRIPPER && servoIndex <= RIGHT_SHOLDER_PITCH)
   {
-    return RIGHT_HAND_GROUP;
+    return DATA_RIGHT_HAND;
   }
   else if (servoIndex >= LEFT_GRIPPER && servoIndex <= LEFT_SHOLDER_PITCH)
   {
-    return LEFT_HAND_GROUP;
+    return DATA_LEFT_HAND;
   }
   else
   {
-    return HEAD_GROUP;
+    return DATA_HEAD;
   }
 }
 
+// Servo name lookup, built at compile time
+static constexpr TokenTable<TOTAL_SERVOS, 32> SERVO_NAME_TABLE(SERVO_NAMES);
+static_assert(SERVO_NAME_TABLE.valid(), "no perfect hash for servo names");
+
 // Find servo index by name
-int findServoByName(const String &name)
+int findServoByName(const char *name)
 {
-  for (int i = 0; i < TOTAL_SERVOS; i++)
+  return SERVO_NAME_TABLE.find(name);
+}
+
+// Mask of the servos and servo groups named in names
+uint16_t parseServoMask(JsonArrayConst names)
+{
+  uint16_t mask = 0;
+  for (JsonVariantConst name : names)
   {
-    if (name == SERVO_NAMES[i])
+    const char *token = name.as<const char *>();
+    int servoIndex = findServoByName(token);
+    if (servoIndex >= 0)
     {
-      return i;
+      mask |= 1 << servoIndex;
+      continue;
     }
+
+    DataType group = parseDataType(token);
+    if (group == DATA_RIGHT_HAND)
+      mask |= RIGHT_HAND_MASK;
+    else if (group == DATA_LEFT_HAND)
+      mask |= LEFT_HAND_MASK;
+    else if (group == DATA_HEAD)
+      mask |= HEAD_MASK;
   }
-  return -1; // Not found
+
+  return mask != 0 ? mask : ALL_SERVOS_MASK;
 }
 
 // Convert angle to servo position using standard mapping:
@@ -135,232 +201,281 @@ float servoPosToAngle(s16 pos, int servoIndex)
   return constrain(angle, minAngle, maxAngle);
 }
 
-void invertAngles(float *angles, int count)
+void setServoMiddle(int servoIndex)
 {
-  for (int i = 0; i < count; i++)
+  if (servoIndex > 0 && !skipQuarantined(servoIndex))
   {
-    angles[i] = -angles[i];
+    lockBus();
+    beginServoReply(servoIndex);
+    int result = st.CalibrationOfs(SERVO_IDS[servoIndex]);
+    endServoReply(servoIndex, result == 1);
+    unlockBus();
   }
+
+  LOG_INFO(SERVO_MIDDLE, SERVO_IDS[servoIndex], SERVO_NAMES[servoIndex]);
 }
 
-// Update a single servo
-bool updateSingleServo(int servoIndex, float angle)
+void releaseServo(int servoIndex)
 {
-  // Store angle for group updates
-  String group = getServoGroup(servoIndex);
-  if (group == RIGHT_HAND_GROUP)
+  if (servoIndex > 0 && !skipQuarantined(servoIndex))
   {
-    angle = -angle;
+    lockBus();
+    beginServoReply(servoIndex);
+    int result = st.EnableTorque(SERVO_IDS[servoIndex], false);
+    endServoReply(servoIndex, result == 1);
+    unlockBus();
   }
 
-  // Convert angle to position
-  s16 targetPos = angleToServoPos(angle, servoIndex);
+  LOG_INFO(SERVO_RELEASED, SERVO_IDS[servoIndex]);
+}
 
-  // Send command to the servo
-  int result = st.WritePosEx(SERVO_IDS[servoIndex], targetPos,
-                             SERVO_SPEED[servoIndex], SERVO_ACC[servoIndex]);
+// Update all addressed servos with a single synchronous write
+bool updateServoTargets(const ServoTargets &targets)
+{
+  byte servos[TOTAL_SERVOS];
+  s16 positions[TOTAL_SERVOS];
+  u16 speeds[TOTAL_SERVOS];
+  byte accs[TOTAL_SERVOS];
+  int count = 0;
+
+  servoCommandInProgress = true;
 
-  if (result != 1)
+  for (int i = 0; i < TOTAL_SERVOS; i++)
   {
-    Serial.print("ERROR: Failed to update servo #");
-    Serial.println(SERVO_IDS[servoIndex]);
-    return false;
+    uint16_t bit = 1 << i;
+
+    if (targets.speedMask & bit)
+    {
+      SERVO_SPEED[i] = constrain(targets.speed[i], 0, 1000);
+    }
+    if (targets.accMask & bit)
+    {
+      SERVO_ACC[i] = constrain(targets.acc[i], 0, 255);
+    }
+    if (!(targets.mask & bit))
+    {
+      continue;
+    }
+
+    // Right hand servos are mounted mirrored
+    float angle = targets.angle[i] / 100.0;
+    if (RIGHT_HAND_MASK & bit)
+    {
+      angle = -angle;
+    }
+
+    servos[count] = SERVO_IDS[i];
+    positions[count] = angleToServoPos(angle, i);
+    speeds[count] = SERVO_SPEED[i];
+    accs[count] = SERVO_ACC[i];
+    count++;
   }
-  else if (DEBUG)
+
+  if (count > 0)
   {
-    Serial.print("Updated servo #");
-    Serial.print(SERVO_IDS[servoIndex]);
-    Serial.print(" (");
-    Serial.print(SERVO_NAMES[servoIndex]);
-    Serial.print(") to angle ");
-    Serial.print(angle);
-    Serial.print(" (position ");
-    Serial.print(targetPos);
-    Serial.println(")");
+    lockBus();
+    st.SyncWritePosEx(servos, count, positions, speeds, accs);
+    unlockBus();
   }
 
+  LOG_DEBUG(SERVO_TARGETS_UPDATED, count);
+
+  servoCommandInProgress = false;
   return true;
 }
 
-void setServoMiddle(int servoIndex)
+// Read the servos of mask with one sync read, each servo waited for at
+// most its own timeout or maxTimeoutUs. Quarantined servos are left out.
+// The bus must be locked.
+static int syncReadFeedback(uint16_t mask, ServoFeedback *feedback, uint32_t maxTimeoutUs)
 {
-  if (servoIndex > 0)
+  u8 ids[TOTAL_SERVOS];
+  u8 indices[TOTAL_SERVOS];
+  u32 timeouts[TOTAL_SERVOS];
+  u8 count = 0;
+  uint16_t quarantined = quarantinedServos();
+  for (int i = 0; i < TOTAL_SERVOS; i++)
   {
-    st.CalibrationOfs(SERVO_IDS[servoIndex]);
-  }
+    if (!(mask & (1 << i)))
+      continue;
 
-  if (DEBUG)
-  {
-    Serial.print("Set servo #");
-    Serial.print(SERVO_IDS[servoIndex]);
-    Serial.print(" (");
-    Serial.print(SERVO_NAMES[servoIndex]);
-    Serial.println(") to middle position (calibration offset)");
-  }
-}
+    if (quarantined & (1 << i))
+    {
+      memset(&feedback[i], 0, sizeof(feedback[i]));
+      feedback[i].status = SERVO_STATUS_NO_RESPONSE | SERVO_STATUS_QUARANTINED;
+      continue;
+    }
 
-void releaseServo(int servoIndex)
-{
-  if (servoIndex > 0)
-  {
-    st.EnableTorque(SERVO_IDS[servoIndex], false);
+    ids[count] = SERVO_IDS[i];
+    timeouts[count] = min(servoTimeoutUs(i), maxTimeoutUs);
+    indices[count++] = i;
   }
 
-  if (DEBUG)
-  {
-    Serial.print("Released servo #");
-    Serial.println(SERVO_IDS[servoIndex]);
-  }
-}
+  if (count == 0)
+    return 0;
 
-// Update a group of servos synchronously
-bool updateServoGroup(byte *indices, int count, float *angles)
-{
-  // Prepare arrays for the SyncWritePosEx function
-  byte servos[count];
-  s16 positions[count];
-  u16 speeds[count];
-  byte accs[count];
+  SMS_STS_FeedBack replies[TOTAL_SERVOS];
+  int answered = st.SyncFeedBack(ids, count, replies, timeouts);
 
-  for (int i = 0; i < count; i++)
+  for (u8 k = 0; k < count; k++)
   {
-    int index = indices[i];
-    servos[i] = SERVO_IDS[index];
-    positions[i] = angleToServoPos(angles[i], index);
-    speeds[i] = SERVO_SPEED[index];
-    accs[i] = SERVO_ACC[index];
+    ServoFeedback &servo = feedback[indices[k]];
+    memset(&servo, 0, sizeof(servo));
+    if (replies[k].Err)
+    {
+      recordServoMiss(indices[k]);
+      servo.status |= SERVO_STATUS_NO_RESPONSE;
+      if (replies[k].Err == 2)
+        servo.status |= SERVO_STATUS_BAD_REPLY;
+      continue;
+    }
+
+    recordServoReply(indices[k], replies[k].ReplyUs);
+    servo.position = replies[k].Pos;
+    servo.speed = replies[k].Speed;
+    servo.load = replies[k].Load;
+    servo.temperature = replies[k].Temper;
   }
 
-  // Update servos synchronously
-  st.SyncWritePosEx(servos, count, positions, speeds, accs);
+  return answered;
+}
 
-  // For debugging
-  if (DEBUG)
-  {
-    Serial.print("Updated servo group of ");
-    Serial.print(count);
-    Serial.println(" servos");
-  }
+// Read every servo in mask into feedback[servo index]
+bool readServoFeedback(uint16_t mask, ServoFeedback *feedback)
+{
+  lockBus();
+  int answered = syncReadFeedback(mask, feedback, SERVO_REPLY_TIMEOUT_US);
+  unlockBus();
 
-  return true;
+  return answered == __builtin_popcount(mask);
 }
 
-// Update right hand servos as a group
-bool updateRightHandServos(float *angles)
+// Read every servo in mask with a reply timeout of at most ioTimeoutUs
+int readServoFeedbackWithin(uint16_t mask, ServoFeedback *feedback, uint32_t ioTimeoutUs)
 {
-  invertAngles(angles, 6);
-  return updateServoGroup(RIGHT_HAND_INDICES, 6, angles);
+  lockBus();
+  int answered = syncReadFeedback(mask, feedback, ioTimeoutUs);
+  unlockBus();
+
+  return answered;
 }
 
-// Update left hand servos as a group
-bool updateLeftHandServos(float *angles)
+// Ping the quarantined servos whose retry is due
+void pingQuarantinedServos()
 {
-  return updateServoGroup(LEFT_HAND_INDICES, 6, angles);
+  uint16_t due = takeServoPingsDue();
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    if (!(due & (1 << i)))
+      continue;
+
+    lockBus();
+    int id = st.Ping(SERVO_IDS[i]);
+    endServoReply(i, id == SERVO_IDS[i]);
+    unlockBus();
+  }
 }
 
-// Update head servos as a group
-bool updateHeadServos(float *angles)
+// Reported angle of a servo in degrees, right hand servos are mirrored
+float servoFeedbackAngle(int servoIndex, s16 position)
 {
-  return updateServoGroup(HEAD_INDICES, 2, angles);
+  float angle = servoPosToAngle(position, servoIndex);
+  if (getServoGroup(servoIndex) == DATA_RIGHT_HAND)
+  {
+    angle = -angle;
+  }
+  return angle;
 }
 
-bool readServoBasedOnGroup(JsonObject &servoGroup, String groupName)
+bool readServoBasedOnGroup(JsonObject &servoGroup, DataType group)
 {
-  bool success = true;
-  int startIndex = -1;
-  int endIndex = -1;
+  uint16_t groupMask;
 
-  // Determine start and end indices based on group name
-  if (groupName == RIGHT_HAND_GROUP)
+  // Determine the servos of the group
+  if (group == DATA_RIGHT_HAND)
   {
-    startIndex = RIGHT_GRIPPER;
-    endIndex = RIGHT_SHOLDER_PITCH;
+    groupMask = RIGHT_HAND_MASK;
   }
-  else if (groupName == LEFT_HAND_GROUP)
+  else if (group == DATA_LEFT_HAND)
   {
-    startIndex = LEFT_GRIPPER;
-    endIndex = LEFT_SHOLDER_PITCH;
+    groupMask = LEFT_HAND_MASK;
   }
-  else if (groupName == HEAD_GROUP)
+  else if (group == DATA_HEAD)
   {
-    startIndex = HEAD_PAN;
-    endIndex = HEAD_TILT;
+    groupMask = HEAD_MASK;
   }
   else
   {
-    Serial.print("ERROR: Unknown group name - ");
-    Serial.println(groupName);
+    LOG_ERROR(SERVO_GROUP_UNKNOWN, dataTypeName(group));
     return false;
   }
 
-  // Read all servos in the specified group
-  for (int i = startIndex; i <= endIndex; i++)
-  {
-    // Create servo object with the exact name from Dart
-    JsonObject servo = servoGroup.createNestedObject(SERVO_NAMES[i]);
+  ServoFeedback feedback[TOTAL_SERVOS];
+  bool success = readServoFeedback(groupMask, feedback);
+  writeServoGroup(servoGroup, groupMask, feedback);
 
-    // Read servo feedback
-    if (st.FeedBack(SERVO_IDS[i]) != -1)
-    {
-      int pos = st.ReadPos(SERVO_IDS[i]);
-      int speed = st.ReadSpeed(SERVO_IDS[i]);
-      int load = st.ReadLoad(SERVO_IDS[i]);
-      int temp = st.ReadTemper(SERVO_IDS[i]);
+  return success;
+}
 
-      // Convert position to angle
-      float angle = servoPosToAngle(pos, i);
+// Add the servos of mask to a group object, keyed by servo name
+void writeServoGroup(JsonObject &servoGroup, uint16_t mask, const ServoFeedback *feedback)
+{
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    if (!(mask & (1 << i)))
+    {
+      continue;
+    }
 
-      // Check if we need to negate the angle (as in the right hand example)
-      // You may need to adjust this logic based on your system's conventions
-      if (groupName == RIGHT_HAND_GROUP)
-      {
-        angle = -angle; // Negate for right hand group as in the example
-      }
+    // Create servo object with the exact name from Dart
+    JsonObject servo = servoGroup[SERVO_NAMES[i]].to<JsonObject>();
 
-      // Add values to match the ServoModel.fromRobotJson format
-      servo["angle"] = angle;
-      servo["speed"] = speed;
-      servo["load"] = load;
-      servo["temp"] = temp;
-      servo["id"] = SERVO_IDS[i];
-    }
-    else
+    if (feedback[i].status & SERVO_STATUS_NO_RESPONSE)
     {
       servo["error"] = true;
-      success = false;
+      if (feedback[i].status & SERVO_STATUS_QUARANTINED)
+        servo["quarantined"] = true;
+      if (feedback[i].status & SERVO_STATUS_BAD_REPLY)
+        servo["badReply"] = true;
+      continue;
     }
-  }
 
-  return success;
+    // Add values to match the ServoModel.fromRobotJson format
+    servo["angle"] = servoFeedbackAngle(i, feedback[i].position);
+    servo["speed"] = feedback[i].speed;
+    servo["load"] = feedback[i].load;
+    servo["temp"] = feedback[i].temperature;
+    servo["id"] = SERVO_IDS[i];
+  }
 }
 
 // the servo object must contain the servo name as type
 bool readSingleServoData(JsonObject &servo)
 {
-  if (servo.containsKey("type"))
+  JsonVariant type = servo["type"];
+  if (!type.isNull())
   {
     bool success = true;
 
-    int servoIndex = findServoByName(servo["type"]);
+    int servoIndex = findServoByName(type.as<const char *>());
 
     if (servoIndex > 0)
     {
 
-      if (st.FeedBack(SERVO_IDS[servoIndex]) != -1)
-      {
-        int pos = st.ReadPos(SERVO_IDS[servoIndex]);
-        int speed = st.ReadSpeed(SERVO_IDS[servoIndex]);
-        int load = st.ReadLoad(SERVO_IDS[servoIndex]);
-        int temp = st.ReadTemper(SERVO_IDS[servoIndex]);
+      ServoFeedback feedback[TOTAL_SERVOS];
+      bool responded = readServoFeedback(1 << servoIndex, feedback);
+      const ServoFeedback &reading = feedback[servoIndex];
 
+      if (responded)
+      {
         // Convert position to angle
-        float angle = servoPosToAngle(pos, servoIndex);
+        float angle = servoPosToAngle(reading.position, servoIndex);
 
         // Add values to match the ServoModel.fromRobotJson format
         servo["angle"] = angle;
-        servo["speed"] = speed;
-        servo["load"] = load;
-        servo["temp"] = temp;
+        servo["speed"] = reading.speed;
+        servo["load"] = reading.load;
+        servo["temp"] = reading.temperature;
         // servo["id"] = SERVO_IDS[servoIndex];
       }
       else
@@ -386,196 +501,198 @@ bool readSingleServoData(JsonObject &servo)
 bool readRightHandServoData(JsonObject &rightHand)
 {
 
-  return readServoBasedOnGroup(rightHand, RIGHT_HAND_GROUP);
+  return readServoBasedOnGroup(rightHand, DATA_RIGHT_HAND);
 }
 
 // New function to read left hand servo data
 bool readLeftHandServoData(JsonObject &leftHand)
 {
-  return readServoBasedOnGroup(leftHand, LEFT_HAND_GROUP);
+  return readServoBasedOnGroup(leftHand, DATA_LEFT_HAND);
 }
 
 // New function to read head servo data
 bool readHeadServoData(JsonObject &head)
 {
-  return readServoBasedOnGroup(head, HEAD_GROUP);
+  return readServoBasedOnGroup(head, DATA_HEAD);
 }
 
-void processServoCommandsOfGroup(JsonObject servos, String group)
+// Parse a group command into servo targets
+bool parseServoCommandsOfGroup(JsonObject servos, DataType group, ServoTargets &targets)
 {
-  // Mark beginning of servo command
-  servoCommandInProgress = true;
-
-  // Arrays to store servo angles for group updates (maximum size needed is 6 for hands)
-  float servoAngles[6] = {0};
-  int groupSize = 0;
-  int groupStartIndex = 0;
+  uint16_t groupMask;
 
   // Determine group parameters
-  if (group == RIGHT_HAND_GROUP)
+  if (group == DATA_RIGHT_HAND)
   {
-    groupSize = 6;
-    groupStartIndex = RIGHT_GRIPPER;
+    groupMask = RIGHT_HAND_MASK;
   }
-  else if (group == LEFT_HAND_GROUP)
+  else if (group == DATA_LEFT_HAND)
   {
-    groupSize = 6;
-    groupStartIndex = LEFT_GRIPPER;
+    groupMask = LEFT_HAND_MASK;
   }
-  else if (group == HEAD_GROUP)
+  else if (group == DATA_HEAD)
   {
-    groupSize = 2;
-    groupStartIndex = HEAD_PAN;
+    groupMask = HEAD_MASK;
   }
   else
   {
     // Invalid group
-    Serial.print("ERROR: Invalid group specified - ");
-    Serial.println(group);
-    servoCommandInProgress = false;
-    return;
+    LOG_ERROR(SERVO_GROUP_INVALID, dataTypeName(group));
+    return false;
   }
 
+  memset(&targets, 0, sizeof(targets));
   bool updateAsGroup = false;
 
   // Process all servo commands using the standardized names
   for (JsonPair kv : servos)
   {
-    String servoName = kv.key().c_str();
+    const char *servoName = kv.key().c_str();
     int servoIndex = findServoByName(servoName);
 
-    if (servoIndex >= 0)
+    // Check if this servo belongs to the specified group
+    if (servoIndex < 0 || getServoGroup(servoIndex) != group)
     {
-      // Check if this servo belongs to the specified group
-      String servoGroup = getServoGroup(servoIndex);
+      continue;
+    }
 
-      if (servoGroup == group)
-      {
-        JsonObject servoObj = kv.value().as<JsonObject>();
-
-        // Process angle command
-        if (servoObj.containsKey("angle"))
-        {
-          float angle = servoObj["angle"];
-
-          if (DEBUG)
-          {
-            Serial.print("Setting servo ");
-            Serial.print(servoName);
-            Serial.print(" to angle ");
-            Serial.println(angle);
-          }
-
-          // Store angle for group updates
-          int relativeIndex = servoIndex - groupStartIndex;
-          servoAngles[relativeIndex] = angle;
-          updateAsGroup = true;
-        }
-
-        // Process speed command
-        if (servoObj.containsKey("speed"))
-        {
-          SERVO_SPEED[servoIndex] = constrain(servoObj["speed"].as<int>(), 0, 1000);
-        }
-
-        // Process acceleration command
-        if (servoObj.containsKey("acc"))
-        {
-          SERVO_ACC[servoIndex] = constrain(servoObj["acc"].as<int>(), 0, 255);
-        }
-      }
+    JsonObject servoObj = kv.value().as<JsonObject>();
+    uint16_t bit = 1 << servoIndex;
+
+    // Process angle command
+    JsonVariant angleValue = servoObj["angle"];
+    if (!angleValue.isNull())
+    {
+      float angle = angleValue;
+
+      LOG_DEBUG(SERVO_SET, SERVO_NAMES[servoIndex], angle);
+
+      targets.angle[servoIndex] = (int16_t)lroundf(angle * 100);
+      updateAsGroup = true;
+    }
+
+    // Process speed command
+    JsonVariant speed = servoObj["speed"];
+    if (!speed.isNull())
+    {
+      targets.speed[servoIndex] = constrain(speed.as<int>(), 0, 1000);
+      targets.speedMask |= bit;
+    }
+
+    // Process acceleration command
+    JsonVariant acc = servoObj["acc"];
+    if (!acc.isNull())
+    {
+      targets.acc[servoIndex] = constrain(acc.as<int>(), 0, 255);
+      targets.accMask |= bit;
     }
   }
 
-  // Now perform updates for the group
+  // A group update moves every servo of the group, missing angles are 0
   if (updateAsGroup)
   {
-    // Update the appropriate group
-    bool updateSuccess = false;
-    if (group == RIGHT_HAND_GROUP)
+    targets.mask = groupMask;
+  }
+
+  return true;
+}
+
+// Parse a body command, only the listed servos are moved
+bool parseServoCommandsOfBody(JsonObject servos, ServoTargets &targets)
+{
+  memset(&targets, 0, sizeof(targets));
+
+  for (JsonPair kv : servos)
+  {
+    int servoIndex = findServoByName(kv.key().c_str());
+    if (servoIndex < 0)
     {
-      updateSuccess = updateRightHandServos(servoAngles);
+      continue;
     }
-    else if (group == LEFT_HAND_GROUP)
+
+    JsonObject servoObj = kv.value().as<JsonObject>();
+    uint16_t bit = 1 << servoIndex;
+
+    JsonVariant angle = servoObj["angle"];
+    if (!angle.isNull())
     {
-      updateSuccess = updateLeftHandServos(servoAngles);
+      targets.angle[servoIndex] = (int16_t)lroundf(angle.as<float>() * 100);
+      targets.mask |= bit;
     }
-    else if (group == HEAD_GROUP)
+    JsonVariant speed = servoObj["speed"];
+    if (!speed.isNull())
     {
-      updateSuccess = updateHeadServos(servoAngles);
+      targets.speed[servoIndex] = constrain(speed.as<int>(), 0, 1000);
+      targets.speedMask |= bit;
     }
-
-    if (!updateSuccess)
+    JsonVariant acc = servoObj["acc"];
+    if (!acc.isNull())
     {
-      Serial.print("ERROR: Failed to update ");
-      Serial.print(group);
-      Serial.println(" servos");
+      targets.acc[servoIndex] = constrain(acc.as<int>(), 0, 255);
+      targets.accMask |= bit;
     }
   }
 
-  // Mark end of servo command
-  servoCommandInProgress = false;
+  return (targets.mask | targets.speedMask | targets.accMask) != 0;
 }
 
-// Process command for a single servo
-void processServoCommandOfSingle(JsonObject servoObj)
+// Parse a command for a single servo
+SingleServoAction parseServoCommandOfSingle(JsonObject servoObj, ServoTargets &targets, int &servoIndex)
 {
-  if (servoObj.containsKey("id"))
+  JsonVariant id = servoObj["id"];
+  if (id.isNull())
   {
-    String servoName = servoObj["id"];
-    int servoIndex = findServoByName(servoName);
+    LOG_ERROR(SERVO_NAME_MISSING);
+    return SINGLE_SERVO_INVALID;
+  }
 
-    if (servoIndex >= 0)
+  const char *servoName = id;
+  servoIndex = findServoByName(servoName);
+  if (servoIndex < 0)
+  {
+    return SINGLE_SERVO_INVALID;
+  }
+
+  // Process angle command
+  JsonVariant angleValue = servoObj["angle"];
+  if (!angleValue.isNull())
+  {
+    float angle = angleValue;
+    uint16_t bit = 1 << servoIndex;
+
+    LOG_DEBUG(SERVO_SINGLE_SET, SERVO_NAMES[servoIndex], angle);
+
+    memset(&targets, 0, sizeof(targets));
+    targets.angle[servoIndex] = (int16_t)lroundf(angle * 100);
+    targets.mask = bit;
+
+    // Process speed command (if present)
+    JsonVariant speed = servoObj["speed"];
+    if (!speed.isNull())
     {
-      // Process angle command
-      if (servoObj.containsKey("angle"))
-      {
-        float angle = servoObj["angle"];
-
-        if (DEBUG)
-        {
-          Serial.print("Setting single servo ");
-          Serial.print(servoName);
-          Serial.print(" to angle ");
-          Serial.println(angle);
-        }
-
-        // Process speed command (if present)
-        if (servoObj.containsKey("speed"))
-        {
-          SERVO_SPEED[servoIndex] = constrain(servoObj["speed"].as<int>(), 0, 1000);
-        }
-
-        // Process acceleration command (if present)
-        if (servoObj.containsKey("acc"))
-        {
-          SERVO_ACC[servoIndex] = constrain(servoObj["acc"].as<int>(), 0, 255);
-        }
-
-        // Update the servo
-        if (!updateSingleServo(servoIndex, angle))
-        {
-          Serial.print("ERROR: Failed to update servo ");
-          Serial.println(servoName);
-        }
-      }
-      else if (servoObj.containsKey("setMiddle"))
-      {
-        setServoMiddle(servoIndex);
-      }
-      else if (servoObj.containsKey("release"))
-      {
-        releaseServo(servoIndex);
-      }
-      else
-      {
-        Serial.print("ERROR: No angle specified for servo ");
-        Serial.println(servoName);
-      }
+      targets.speed[servoIndex] = constrain(speed.as<int>(), 0, 1000);
+      targets.speedMask = bit;
     }
+
+    // Process acceleration command (if present)
+    JsonVariant acc = servoObj["acc"];
+    if (!acc.isNull())
+    {
+      targets.acc[servoIndex] = constrain(acc.as<int>(), 0, 255);
+      targets.accMask = bit;
+    }
+
+    return SINGLE_SERVO_MOVE;
   }
-  else
+  else if (!servoObj["setMiddle"].isNull())
+  {
+    return SINGLE_SERVO_MIDDLE;
+  }
+  else if (!servoObj["release"].isNull())
   {
-    Serial.println("ERROR: Invalid servo name - ");
+    return SINGLE_SERVO_RELEASE;
   }
-}
\ No newline at end of file
+
+  LOG_ERROR(SERVO_ANGLE_MISSING, SERVO_NAMES[servoIndex]);
+  return SINGLE_SERVO_INVALID;
+}
@@ -5,21 +5,55 @@
 #include <SCServo.h>
 #include <ArduinoJson.h>
 #include "configs.h"
+#include "protocol.h"
+
+// Target set for any subset of servos (angles in centidegrees)
+struct ServoTargets
+{
+  uint16_t mask;      // servos with a new angle
+  uint16_t speedMask; // servos with a new speed
+  uint16_t accMask;   // servos with a new acceleration
+  int16_t angle[TOTAL_SERVOS];
+  u16 speed[TOTAL_SERVOS];
+  byte acc[TOTAL_SERVOS];
+};
+
+// Feedback of one servo as read from the bus
+struct ServoFeedback
+{
+  s16 position; // raw position, 2048 = 0 degrees
+  s16 speed;
+  s16 load;
+  u8 temperature;
+  u8 status; // SERVO_STATUS_* bits
+};
+
+#define SERVO_STATUS_NO_RESPONSE 0x01
+#define SERVO_STATUS_QUARANTINED 0x02 // not read, see servo_health.h, always with NO_RESPONSE
+#define SERVO_STATUS_BAD_REPLY 0x04   // reply failed its checks, always with NO_RESPONSE
 
 // Initialize servo system
 void initializeServos(HardwareSerial &servoSerial);
 
-// Update a single servo
-bool updateSingleServo(int servoIndex, float angle);
+// Find servo index by name, -1 if unknown
+int findServoByName(const char *name);
 
-// Update right hand servos as a group
-bool updateRightHandServos(float *angles);
+// Mask of the servos and servo groups named in names, all servos when
+// names is empty or missing
+uint16_t parseServoMask(JsonArrayConst names);
 
-// Update left hand servos as a group
-bool updateLeftHandServos(float *angles);
+// Update all addressed servos with a single synchronous write
+bool updateServoTargets(const ServoTargets &targets);
 
-// Update head servos as a group
-bool updateHeadServos(float *angles);
+// Calibrate the current position as servo middle
+void setServoMiddle(int servoIndex);
+
+// Disable servo torque
+void releaseServo(int servoIndex);
+
+// Ping the quarantined servos whose retry is due, re-admitting those that
+// answer. Control task only.
+void pingQuarantinedServos();
 
 // Update all servos at once
 // bool updateAllServos(float *angles);
@@ -27,6 +61,20 @@ bool updateHeadServos(float *angles);
 // Read servo data into JSON object
 // bool readServoData(JsonObject &servos);
 
+// Read every servo in mask into feedback[servo index] with one sync
+// read, false if any failed
+bool readServoFeedback(uint16_t mask, ServoFeedback *feedback);
+
+// As readServoFeedback with a servo reply timeout of ioTimeoutUs. Returns
+// how many servos answered, the others get SERVO_STATUS_NO_RESPONSE.
+int readServoFeedbackWithin(uint16_t mask, ServoFeedback *feedback, uint32_t ioTimeoutUs);
+
+// Add the servos of mask to a group object, keyed by servo name
+void writeServoGroup(JsonObject &servoGroup, uint16_t mask, const ServoFeedback *feedback);
+
+// Reported angle of a servo in degrees, right hand servos are mirrored
+float servoFeedbackAngle(int servoIndex, s16 position);
+
 bool readSingleServoData(JsonObject &servo);
 
 bool readRightHandServoData(JsonObject &rightHand);
@@ -35,10 +83,22 @@ bool readLeftHandServoData(JsonObject &rightHand);
 
 bool readHeadServoData(JsonObject &rightHand);
 
-// Process servo commands from JSON
-void processServoCommands(JsonObject servos);
+// Actions carried by a single servo command
+enum SingleServoAction
+{
+  SINGLE_SERVO_INVALID,
+  SINGLE_SERVO_MOVE,
+  SINGLE_SERVO_MIDDLE,
+  SINGLE_SERVO_RELEASE,
+};
+
+// Parse servo commands from JSON
+bool parseServoCommandsOfGroup(JsonObject servos, DataType group, ServoTargets &targets);
+
+// Parse a body command, only the listed servos are moved
+bool parseServoCommandsOfBody(JsonObject servos, ServoTargets &targets);
 
-void processServoCommandOfSingle(JsonObject servoObj);
+SingleServoAction parseServoCommandOfSingle(JsonObject servoObj, ServoTargets &targets, int &servoIndex);
 
 // bool readServoBasedOnGroup(JsonObject &servoGroup, String groupName);
 
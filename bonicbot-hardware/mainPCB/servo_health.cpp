@@ -0,0 +1,158 @@
+#include "servo_health.h"
+#include "debug_log.h"
+
+struct ServoHealth
+{
+  bool measured;      // latency holds at least one sample
+  uint32_t latencyUs; // smoothed latency
+  uint32_t deviationUs;
+  uint32_t timeoutUs; // valid once measured
+  uint8_t streak;     // missed replies in a row
+  uint32_t missed;
+  uint32_t nextPingAt; // millis(), while quarantined
+};
+
+static portMUX_TYPE healthLock = portMUX_INITIALIZER_UNLOCKED;
+static ServoHealth health[TOTAL_SERVOS];
+static uint16_t quarantined = 0;
+static uint32_t quarantines = 0;
+static uint32_t pings = 0;
+
+static uint32_t boundedTimeout(uint32_t timeoutUs)
+{
+  return constrain(timeoutUs, (uint32_t)SERVO_TIMEOUT_MIN_US, (uint32_t)SERVO_REPLY_TIMEOUT_US);
+}
+
+// Until its first reply a servo gets the full timeout
+static uint32_t currentTimeout(const ServoHealth &servo)
+{
+  return servo.measured ? servo.timeoutUs : SERVO_REPLY_TIMEOUT_US;
+}
+
+// Servos currently left out of reads and acked writes
+uint16_t quarantinedServos()
+{
+  portENTER_CRITICAL(&healthLock);
+  uint16_t mask = quarantined;
+  portEXIT_CRITICAL(&healthLock);
+  return mask;
+}
+
+// Reply timeout for one servo
+uint32_t servoTimeoutUs(int servoIndex)
+{
+  portENTER_CRITICAL(&healthLock);
+  uint32_t timeoutUs = currentTimeout(health[servoIndex]);
+  portEXIT_CRITICAL(&healthLock);
+  return timeoutUs;
+}
+
+// A servo answered after latencyUs, re-admits it if quarantined
+void recordServoReply(int servoIndex, uint32_t latencyUs)
+{
+  portENTER_CRITICAL(&healthLock);
+  ServoHealth &servo = health[servoIndex];
+  bool readmitted = quarantined & (1 << servoIndex);
+  if (readmitted)
+  {
+    // Start over, the servo may have come back with other settings
+    quarantined &= ~(1 << servoIndex);
+    servo.measured = false;
+  }
+
+  if (!servo.measured)
+  {
+    servo.latencyUs = latencyUs;
+    servo.deviationUs = latencyUs / 2;
+    servo.measured = true;
+  }
+  else
+  {
+    uint32_t error = latencyUs > servo.latencyUs ? latencyUs - servo.latencyUs : servo.latencyUs - latencyUs;
+    servo.deviationUs = (servo.deviationUs * 3 + error) / 4;
+    servo.latencyUs = (servo.latencyUs * 7 + latencyUs) / 8;
+  }
+  servo.timeoutUs = boundedTimeout(servo.latencyUs + 4 * servo.deviationUs);
+  servo.streak = 0;
+  portEXIT_CRITICAL(&healthLock);
+
+  if (readmitted)
+    LOG_INFO(SERVO_READMITTED, SERVO_IDS[servoIndex], latencyUs);
+}
+
+// A servo did not answer in time
+void recordServoMiss(int servoIndex)
+{
+  portENTER_CRITICAL(&healthLock);
+  ServoHealth &servo = health[servoIndex];
+  servo.missed++;
+  if (servo.streak < 255)
+    servo.streak++;
+  servo.timeoutUs = boundedTimeout(currentTimeout(servo) * 2);
+  servo.nextPingAt = millis() + SERVO_QUARANTINE_PING_MS;
+
+  bool quarantine = servo.streak >= SERVO_QUARANTINE_FAILURES && !(quarantined & (1 << servoIndex));
+  if (quarantine)
+  {
+    quarantined |= 1 << servoIndex;
+    quarantines++;
+  }
+  portEXIT_CRITICAL(&healthLock);
+
+  if (quarantine)
+    LOG_WARN(SERVO_QUARANTINED, SERVO_IDS[servoIndex], SERVO_QUARANTINE_FAILURES);
+}
+
+// Quarantined servos whose ping is due, counted as pinged
+uint16_t takeServoPingsDue()
+{
+  uint16_t due = 0;
+  uint32_t now = millis();
+
+  portENTER_CRITICAL(&healthLock);
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    if ((quarantined & (1 << i)) && (int32_t)(now - health[i].nextPingAt) >= 0)
+    {
+      due |= 1 << i;
+      pings++;
+    }
+  }
+  portEXIT_CRITICAL(&healthLock);
+
+  return due;
+}
+
+// Ticks until the next ping is due, portMAX_DELAY if none is quarantined
+TickType_t servoPingWait()
+{
+  uint32_t now = millis();
+  int32_t wait = INT32_MAX;
+
+  portENTER_CRITICAL(&healthLock);
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    if (quarantined & (1 << i))
+      wait = min(wait, (int32_t)(health[i].nextPingAt - now));
+  }
+  portEXIT_CRITICAL(&healthLock);
+
+  if (wait == INT32_MAX)
+    return portMAX_DELAY;
+  return wait > 0 ? pdMS_TO_TICKS(wait) : 0;
+}
+
+void getServoHealthStats(ServoHealthStats &stats)
+{
+  portENTER_CRITICAL(&healthLock);
+  stats.quarantined = quarantined;
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    stats.latencyUs[i] = health[i].latencyUs;
+    stats.timeoutUs[i] = currentTimeout(health[i]);
+    stats.missed[i] = health[i].missed;
+  }
+  stats.quarantines = quarantines;
+  stats.pings = pings;
+  portEXIT_CRITICAL(&healthLock);
+}
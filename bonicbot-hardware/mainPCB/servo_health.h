@@ -0,0 +1,56 @@
+#ifndef SERVO_HEALTH_H
+#define SERVO_HEALTH_H
+
+#include <Arduino.h>
+#include "configs.h"
+
+// ======================================================================
+// Servo Health
+// ======================================================================
+// Reply latency and failure streak of every servo on the bus. Each reply
+// updates a smoothed latency and its deviation, the servo's reply timeout
+// is latency + 4 * deviation, kept between SERVO_TIMEOUT_MIN_US and
+// SERVO_REPLY_TIMEOUT_US. A missed reply doubles the timeout up to the
+// same limit.
+//
+// After SERVO_QUARANTINE_FAILURES missed replies in a row a servo is
+// quarantined: sync reads leave it out and report it with
+// SERVO_STATUS_QUARANTINED, acked writes to it fail without touching the
+// bus. The control task pings it every SERVO_QUARANTINE_PING_MS and the
+// first answer re-admits it. Sync writes are not acknowledged and still
+// include it, so a servo that comes back follows its targets at once.
+//
+// Callers hold the servo bus lock, a spinlock only guards the snapshot
+// read by the diagnostics stream.
+
+struct ServoHealthStats
+{
+  uint16_t quarantined;             // servo mask
+  uint32_t latencyUs[TOTAL_SERVOS]; // smoothed reply latency
+  uint32_t timeoutUs[TOTAL_SERVOS]; // current reply timeout
+  uint32_t missed[TOTAL_SERVOS];    // replies missed since boot
+  uint32_t quarantines;             // times a servo was quarantined
+  uint32_t pings;                   // pings sent to quarantined servos
+};
+
+// Servos currently left out of reads and acked writes
+uint16_t quarantinedServos();
+
+// Reply timeout for one servo
+uint32_t servoTimeoutUs(int servoIndex);
+
+// A servo answered after latencyUs, re-admits it if quarantined
+void recordServoReply(int servoIndex, uint32_t latencyUs);
+
+// A servo did not answer in time
+void recordServoMiss(int servoIndex);
+
+// Quarantined servos whose ping is due, counted as pinged
+uint16_t takeServoPingsDue();
+
+// Ticks until the next ping is due, portMAX_DELAY if none is quarantined
+TickType_t servoPingWait();
+
+void getServoHealthStats(ServoHealthStats &stats);
+
+#endif // SERVO_HEALTH_H
@@ -0,0 +1,456 @@
+#include "telemetry.h"
+#include "communication.h"
+#include "command_trace.h"
+#include "feedback_frame.h"
+#include "telemetry_history.h"
+
+typedef bool (*DataReaderFunc)(JsonObject &);
+
+// Every feedback reading in one document, the servos from one bus pass
+static bool readStateData(JsonObject &state)
+{
+  ServoFeedback feedback[TOTAL_SERVOS];
+  bool success = readServoFeedback(ALL_SERVOS_MASK, feedback);
+
+  JsonObject rightHand = state[RIGHT_HAND_GROUP].to<JsonObject>();
+  writeServoGroup(rightHand, RIGHT_HAND_MASK, feedback);
+  JsonObject leftHand = state[LEFT_HAND_GROUP].to<JsonObject>();
+  writeServoGroup(leftHand, LEFT_HAND_MASK, feedback);
+  JsonObject head = state[HEAD_GROUP].to<JsonObject>();
+  writeServoGroup(head, HEAD_MASK, feedback);
+
+  JsonObject base = state[BASE].to<JsonObject>();
+  success &= readBaseMotorData(base);
+  JsonObject battery = state[BATTERY].to<JsonObject>();
+  success &= readBmsData(battery);
+  JsonObject distance = state[DISTANCE].to<JsonObject>();
+  success &= readDistanceData(distance);
+
+  return success;
+}
+
+// Reader and destination of each stream
+struct StreamConfig
+{
+  DataReaderFunc reader;
+  LinkChannel channel;
+  const char *name; // servo streams use the servo name
+  bool continuous;  // false for one-time only streams
+  uint8_t group;    // packed frame group id
+  uint16_t servoMask; // servos of a packed frame, 0 if not a servo stream
+  bool fragmented;    // larger than one notification, see sendFragmented
+};
+
+static const StreamConfig STREAMS[STREAM_COUNT] = {
+    {readBmsData, LINK_CHANNEL_BATTERY, "battery", true, 0, 0, false},
+    {readLeftHandServoData, LINK_CHANNEL_LEFT_HAND, "left hand servos", true, FRAME_GROUP_LEFT_HAND, LEFT_HAND_MASK, false},
+    {readRightHandServoData, LINK_CHANNEL_RIGHT_HAND, "right hand servos", true, FRAME_GROUP_RIGHT_HAND, RIGHT_HAND_MASK, false},
+    {readHeadServoData, LINK_CHANNEL_HEAD, "head servos", true, FRAME_GROUP_HEAD, HEAD_MASK, false},
+    {readBaseMotorData, LINK_CHANNEL_BASE, "base", true, 0, 0, false},
+    {readDistanceData, LINK_CHANNEL_DISTANCE, "distance", true, 0, 0, false},
+    {readSingleServoData, LINK_CHANNEL_SERVO, "servo", true, FRAME_GROUP_ALL, ALL_SERVOS_MASK, false},
+    {readDiagnosticsData, LINK_CHANNEL_DIAGNOSTICS, DIAGNOSTICS, true, 0, 0, true},
+    {readStateData, LINK_CHANNEL_STATE, STATE, true, 0, 0, true},
+    {nullptr, LINK_CHANNEL_HISTORY, HISTORY, true, 0, 0, false},
+};
+
+struct StreamState
+{
+  bool active;
+  uint32_t intervalUs;
+  uint32_t nextDue; // micros()
+  int8_t servoIndex;
+  TelemetryOptions options;
+  uint32_t deltaRuns;  // runs since the stream started, picks keyframes
+  bool resetSnapshot;  // drop the delta snapshot before the next run
+  bool oneShot;
+  int8_t oneShotServoIndex;
+  TelemetryFormat oneShotFormat;
+  uint16_t packedSeq;
+
+  uint32_t runs;
+  uint32_t overruns;
+  uint32_t suppressed;
+  uint32_t windowStart;
+  uint32_t windowRuns;
+  float rateHz;
+  uint32_t lastRunUs;
+};
+
+// One run taken off the schedule
+struct StreamRun
+{
+  TelemetryStream stream;
+  int servoIndex;
+  bool oneShot;
+  TelemetryOptions options;
+  bool keyframe;      // delta mode, send every field
+  bool resetSnapshot; // delta mode, forget the last sent values first
+};
+
+static portMUX_TYPE streamLock = portMUX_INITIALIZER_UNLOCKED;
+static StreamState states[STREAM_COUNT] = {};
+static TaskHandle_t telemetryTaskHandle = nullptr;
+
+// Last sent values of packed delta streams, only used by the telemetry task.
+// Document streams keep theirs in the channel, see channelSnapshotDocument.
+static ServoFeedback feedbackSnapshots[STREAM_COUNT][TOTAL_SERVOS];
+
+void setDefaultTelemetryOptions(TelemetryOptions &options)
+{
+  options.format = FORMAT_DOCUMENT;
+  options.delta = false;
+  options.keyframeEvery = TELEMETRY_KEYFRAME_EVERY;
+  setDefaultDeadbands(options.deadbands);
+}
+
+// Signed distance between two micros() values, wrap safe
+static int32_t timeUntil(uint32_t deadline, uint32_t now)
+{
+  return (int32_t)(deadline - now);
+}
+
+static void wakeTelemetryTask()
+{
+  if (telemetryTaskHandle != nullptr)
+    xTaskNotifyGive(telemetryTaskHandle);
+}
+
+// Read the servos of a stream into one packed frame, false if a delta
+// run had nothing to send
+static bool runPackedStream(const StreamRun &run, uint16_t mask)
+{
+  ServoFeedback feedback[TOTAL_SERVOS];
+  uint8_t frame[FEEDBACK_MAX_SIZE];
+
+  readServoFeedback(mask, feedback);
+
+  bool delta = run.options.delta && !run.keyframe;
+  if (run.options.delta)
+  {
+    mask = diffServoFeedback(mask, feedback, feedbackSnapshots[run.stream],
+                             run.options.deadbands, run.keyframe);
+    if (mask == 0)
+      return false;
+  }
+
+  portENTER_CRITICAL(&streamLock);
+  uint16_t seq = states[run.stream].packedSeq++;
+  portEXIT_CRITICAL(&streamLock);
+
+  size_t len = encodeFeedbackFrame(frame, STREAMS[run.stream].group, seq, millis(), mask, feedback, delta);
+  sendResponse(frame, len, STREAMS[run.stream].channel);
+  return true;
+}
+
+// Reduce a read to the fields that changed, false if there are none
+static bool buildDeltaDocument(const StreamRun &run, JsonObjectConst root, JsonDocument &delta)
+{
+  LinkChannel channel = STREAMS[run.stream].channel;
+  if (run.resetSnapshot)
+    resetChannelSnapshot(channel);
+  JsonDocument &snapshot = channelSnapshotDocument(channel);
+  JsonObject last = snapshot.is<JsonObject>() ? snapshot.as<JsonObject>() : snapshot.to<JsonObject>();
+
+  JsonObject out = delta.to<JsonObject>();
+  out["id"] = root["id"];
+  int changed = diffTelemetryDocument(root, last, out, run.options.deadbands, run.keyframe);
+  if (changed == 0 && !run.keyframe)
+    return false;
+
+  out["delta"] = true;
+  out["keyframe"] = run.keyframe;
+  return true;
+}
+
+// Read one stream and send it, false if a delta run had nothing to send
+static bool runStream(const StreamRun &run)
+{
+  if (run.stream == STREAM_HISTORY)
+    return !run.oneShot && recordHistorySample();
+
+  const StreamConfig &config = STREAMS[run.stream];
+  const char *name = config.name;
+  uint16_t mask = config.servoMask;
+  if (run.stream == STREAM_SERVO)
+  {
+    if (run.servoIndex < 0)
+      return false;
+    name = SERVO_NAMES[run.servoIndex];
+    mask = 1 << run.servoIndex;
+  }
+
+  if (run.options.format == FORMAT_PACKED && mask != 0)
+    return runPackedStream(run, mask);
+
+  resetChannelDocuments(config.channel);
+  JsonDocument &doc = channelDocument(config.channel);
+  JsonObject root = doc.to<JsonObject>();
+  root[run.oneShot ? "type" : "id"] = name;
+  config.reader(root);
+
+  if (run.options.delta)
+  {
+    JsonDocument &delta = channelDeltaDocument(config.channel);
+    if (!buildDeltaDocument(run, root, delta))
+      return false;
+    delta["timestamp"] = millis();
+    delta["continuous"] = true;
+    sendChannelDocument(delta, config.channel, config.fragmented);
+  }
+  else
+  {
+    root["timestamp"] = millis();
+    root["continuous"] = !run.oneShot;
+    sendChannelDocument(doc, config.channel, config.fragmented);
+  }
+
+  LOG_DEBUG(STREAM_SENT, run.oneShot ? "One-time" : "Continuous", name);
+  return true;
+}
+
+// Pick a one-time read, else the most overdue stream. Advances the
+// stream's deadline; returns STREAM_COUNT and the wait in us if none is due
+static TelemetryStream takeDueStream(uint32_t now, StreamRun &run, int32_t &waitUs)
+{
+  TelemetryStream due = STREAM_COUNT;
+  int32_t mostOverdue = 1;
+  waitUs = INT32_MAX;
+
+  for (int i = 0; i < STREAM_COUNT; i++)
+  {
+    StreamState &state = states[i];
+    if (state.oneShot)
+    {
+      state.oneShot = false;
+      run.stream = (TelemetryStream)i;
+      run.servoIndex = state.oneShotServoIndex;
+      run.oneShot = true;
+      setDefaultTelemetryOptions(run.options);
+      run.options.format = state.oneShotFormat;
+      run.keyframe = false;
+      run.resetSnapshot = false;
+      return run.stream;
+    }
+    if (!state.active)
+      continue;
+
+    int32_t until = timeUntil(state.nextDue, now);
+    if (until <= 0 && until < mostOverdue)
+    {
+      mostOverdue = until;
+      due = (TelemetryStream)i;
+    }
+    else if (until > 0 && until < waitUs)
+    {
+      waitUs = until;
+    }
+  }
+
+  if (due == STREAM_COUNT)
+    return due;
+
+  // Keep the phase, skipping deadlines that already passed
+  StreamState &state = states[due];
+  uint32_t behind = now - state.nextDue;
+  uint32_t skipped = behind / state.intervalUs;
+  state.overruns += skipped;
+  state.nextDue += (skipped + 1) * state.intervalUs;
+  run.stream = due;
+  run.servoIndex = state.servoIndex;
+  run.oneShot = false;
+  run.options = state.options;
+  run.keyframe = state.deltaRuns % state.options.keyframeEvery == 0;
+  run.resetSnapshot = state.resetSnapshot;
+  state.deltaRuns++;
+  state.resetSnapshot = false;
+  return due;
+}
+
+static void telemetryTask(void *param)
+{
+  for (;;)
+  {
+    uint32_t now = micros();
+    StreamRun run;
+    int32_t waitUs;
+
+    portENTER_CRITICAL(&streamLock);
+    TelemetryStream stream = takeDueStream(now, run, waitUs);
+    portEXIT_CRITICAL(&streamLock);
+
+    if (stream == STREAM_COUNT)
+    {
+      TickType_t ticks = waitUs == INT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS((waitUs + 999) / 1000);
+      ulTaskNotifyTake(pdTRUE, ticks);
+      continue;
+    }
+
+    bool sent = runStream(run);
+    uint32_t done = micros();
+
+    portENTER_CRITICAL(&streamLock);
+    StreamState &state = states[stream];
+    if (sent)
+      state.runs++;
+    else
+      state.suppressed++;
+    state.lastRunUs = done - now;
+    state.windowRuns++;
+    if (done - state.windowStart >= 1000000)
+    {
+      state.rateHz = state.windowRuns * 1e6f / (done - state.windowStart);
+      state.windowStart = done;
+      state.windowRuns = 0;
+    }
+    portEXIT_CRITICAL(&streamLock);
+  }
+}
+
+// Create the telemetry task
+void initializeTelemetry()
+{
+  xTaskCreatePinnedToCore(telemetryTask, "telemetry", TELEMETRY_TASK_STACK, nullptr,
+                          TELEMETRY_TASK_PRIORITY, &telemetryTaskHandle, TELEMETRY_TASK_CORE);
+
+  LOG_INFO(TELEMETRY_TASK_STARTED);
+}
+
+// Stream for a data type, STREAM_COUNT if there is none
+TelemetryStream telemetryStreamFor(DataType dataType)
+{
+  switch (dataType)
+  {
+  case DATA_BATTERY:
+    return STREAM_BATTERY;
+  case DATA_LEFT_HAND:
+    return STREAM_LEFT_HAND;
+  case DATA_RIGHT_HAND:
+    return STREAM_RIGHT_HAND;
+  case DATA_HEAD:
+    return STREAM_HEAD;
+  case DATA_BASE:
+    return STREAM_BASE;
+  case DATA_DISTANCE:
+    return STREAM_DISTANCE;
+  case DATA_SERVO:
+    return STREAM_SERVO;
+  case DATA_DIAGNOSTICS:
+    return STREAM_DIAGNOSTICS;
+  case DATA_STATE:
+    return STREAM_STATE;
+  case DATA_HISTORY:
+    return STREAM_HISTORY;
+  default:
+    return STREAM_COUNT;
+  }
+}
+
+// Start or retime a continuous stream, default options if null
+bool startTelemetryStream(TelemetryStream stream, uint32_t intervalMs, int servoIndex,
+                          const TelemetryOptions *options)
+{
+  if (stream >= STREAM_COUNT || !STREAMS[stream].continuous || intervalMs == 0)
+    return false;
+
+  TelemetryOptions selected;
+  if (options != nullptr)
+    selected = *options;
+  else
+    setDefaultTelemetryOptions(selected);
+  if (selected.keyframeEvery == 0)
+    selected.keyframeEvery = 1;
+
+  uint32_t now = micros();
+  uint32_t start = now;
+
+  portENTER_CRITICAL(&streamLock);
+
+  // Offset the first deadline away from the other streams
+  for (int attempt = 0; attempt < STREAM_COUNT; attempt++)
+  {
+    bool clash = false;
+    for (int i = 0; i < STREAM_COUNT && !clash; i++)
+    {
+      if (i == stream || !states[i].active)
+        continue;
+      int32_t gap = timeUntil(states[i].nextDue, start);
+      clash = gap > -TELEMETRY_SPREAD_MS * 1000 && gap < TELEMETRY_SPREAD_MS * 1000;
+    }
+    if (!clash)
+      break;
+    start += TELEMETRY_SPREAD_MS * 1000;
+  }
+
+  StreamState &state = states[stream];
+  state.active = true;
+  state.intervalUs = intervalMs * 1000;
+  state.nextDue = start;
+  state.servoIndex = servoIndex;
+  state.options = selected;
+  state.deltaRuns = 0;
+  state.resetSnapshot = true;
+  state.windowStart = now;
+  state.windowRuns = 0;
+  state.rateHz = 0;
+  portEXIT_CRITICAL(&streamLock);
+
+  wakeTelemetryTask();
+  return true;
+}
+
+// Read a stream once, as soon as the task is free
+bool requestTelemetryOnce(TelemetryStream stream, int servoIndex, TelemetryFormat format)
+{
+  if (stream >= STREAM_COUNT)
+    return false;
+
+  portENTER_CRITICAL(&streamLock);
+  states[stream].oneShot = true;
+  states[stream].oneShotServoIndex = servoIndex;
+  states[stream].oneShotFormat = format;
+  portEXIT_CRITICAL(&streamLock);
+
+  wakeTelemetryTask();
+  return true;
+}
+
+// Stop one stream
+void stopTelemetryStream(TelemetryStream stream)
+{
+  if (stream >= STREAM_COUNT)
+    return;
+
+  portENTER_CRITICAL(&streamLock);
+  states[stream].active = false;
+  states[stream].rateHz = 0;
+  portEXIT_CRITICAL(&streamLock);
+}
+
+// Stop all streams
+void stopAllTelemetryStreams()
+{
+  portENTER_CRITICAL(&streamLock);
+  for (int i = 0; i < STREAM_COUNT; i++)
+  {
+    states[i].active = false;
+    states[i].rateHz = 0;
+  }
+  portEXIT_CRITICAL(&streamLock);
+}
+
+// Snapshot of one stream's counters
+void getTelemetryStreamStats(TelemetryStream stream, TelemetryStreamStats &stats)
+{
+  portENTER_CRITICAL(&streamLock);
+  const StreamState &state = states[stream];
+  stats.name = STREAMS[stream].name;
+  stats.active = state.active;
+  stats.intervalMs = state.intervalUs / 1000;
+  stats.runs = state.runs;
+  stats.overruns = state.overruns;
+  stats.suppressed = state.suppressed;
+  stats.rateHz = state.rateHz;
+  stats.lastRunUs = state.lastRunUs;
+  portEXIT_CRITICAL(&streamLock);
+}
@@ -0,0 +1,99 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "configs.h"
+#include "protocol.h"
+#include "telemetry_delta.h"
+
+// ======================================================================
+// Telemetry Task
+// ======================================================================
+// One task runs every telemetry stream from a deadline-ordered schedule,
+// so the blocking BMS, distance and servo readers never run in esp_timer
+// context. A stream's next deadline advances by whole intervals; missed
+// deadlines are skipped and counted as overruns. A newly started stream
+// gets its first deadline offset by TELEMETRY_SPREAD_MS steps from the
+// other streams so readers don't pile onto the same tick.
+//
+// One-time reads (receiveSingle) run on the same task ahead of any
+// deadline.
+//
+// Servo streams can be subscribed with FORMAT_PACKED, each run then sends
+// one feedback_frame.h frame instead of a document.
+//
+// STREAM_STATE carries every feedback reading in one document with one
+// timestamp, the servos read in a single bus pass, and is sent fragmented
+// (see sendFragmented) on the state characteristic. STREAM_DIAGNOSTICS
+// outgrew one notification as well and is sent the same way.
+//
+// STREAM_HISTORY sends nothing, each run records one telemetry_history.h
+// sample.
+//
+// A continuous stream subscribed with "delta": true only sends what changed
+// beyond its deadbands (telemetry_delta.h), with a full keyframe every
+// keyframeEvery runs. Delta documents carry "delta": true and "keyframe",
+// delta packed frames use FEEDBACK_MAGIC_DELTA.
+
+enum TelemetryStream : uint8_t
+{
+  STREAM_BATTERY,
+  STREAM_LEFT_HAND,
+  STREAM_RIGHT_HAND,
+  STREAM_HEAD,
+  STREAM_BASE,
+  STREAM_DISTANCE,
+  STREAM_SERVO,
+  STREAM_DIAGNOSTICS,
+  STREAM_STATE,
+  STREAM_HISTORY,
+  STREAM_COUNT,
+};
+
+// Per subscription options
+struct TelemetryOptions
+{
+  TelemetryFormat format;
+  bool delta;            // send only changes beyond the deadbands
+  uint8_t keyframeEvery; // full message every N runs in delta mode
+  Deadbands deadbands;
+};
+
+struct TelemetryStreamStats
+{
+  const char *name;
+  bool active;         // running continuously
+  uint32_t intervalMs; // requested interval
+  uint32_t runs;       // reads sent, one-time reads included
+  uint32_t overruns;   // deadlines skipped because a run was late
+  uint32_t suppressed; // delta runs with nothing to send
+  float rateHz;        // achieved rate over the last second
+  uint32_t lastRunUs;  // read and send time of the last run
+};
+
+void setDefaultTelemetryOptions(TelemetryOptions &options);
+
+// Create the telemetry task
+void initializeTelemetry();
+
+// Stream for a data type, STREAM_COUNT if there is none
+TelemetryStream telemetryStreamFor(DataType dataType);
+
+// Start or retime a continuous stream, default options if null
+bool startTelemetryStream(TelemetryStream stream, uint32_t intervalMs, int servoIndex = -1,
+                          const TelemetryOptions *options = nullptr);
+
+// Read a stream once, as soon as the task is free. One-time reads are
+// always sent in full.
+bool requestTelemetryOnce(TelemetryStream stream, int servoIndex = -1,
+                          TelemetryFormat format = FORMAT_DOCUMENT);
+
+// Stop one stream, or all of them
+void stopTelemetryStream(TelemetryStream stream);
+void stopAllTelemetryStreams();
+
+// Snapshot of one stream's counters
+void getTelemetryStreamStats(TelemetryStream stream, TelemetryStreamStats &stats);
+
+#endif // TELEMETRY_H
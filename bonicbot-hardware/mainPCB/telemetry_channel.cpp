@@ -0,0 +1,194 @@
+#include "telemetry_channel.h"
+#include "json_arena.h"
+#include <BLE2902.h>
+#include "notify_sender.h"
+#include "communication.h"
+
+struct ChannelConfig
+{
+  const char *name;
+  bool mergeable;         // see notify_sender.h
+  size_t arenaSize;       // read and delta documents, 0 for binary channels
+  size_t outputSize;      // largest serialized document
+  DataType dataType;      // stream started by subscribing, DATA_UNKNOWN for none
+  uint16_t subscribeMs;   // interval of that stream
+};
+
+static const ChannelConfig CHANNELS[LINK_CHANNEL_COUNT] = {
+    {"none", false, 0, 0, DATA_UNKNOWN, 0},
+    {BATTERY, true, 2048, 256, DATA_BATTERY, 3000},
+    {DISTANCE, true, 2048, 128, DATA_DISTANCE, 500},
+    {BASE, true, 2048, 512, DATA_BASE, 200},
+    {RIGHT_HAND_GROUP, true, 4096, 1024, DATA_RIGHT_HAND, 200},
+    {LEFT_HAND_GROUP, true, 4096, 1024, DATA_LEFT_HAND, 200},
+    {HEAD_GROUP, true, 4096, 512, DATA_HEAD, 200},
+    {SERVO, true, 2048, 256, DATA_UNKNOWN, 0}, // needs a servo name
+    {"ack", false, 0, 0, DATA_UNKNOWN, 0},
+    {DIAGNOSTICS, false, 8192, FRAGMENTED_MESSAGE_MAX, DATA_DIAGNOSTICS, 1000},
+    {STATE, false, 8192, FRAGMENTED_MESSAGE_MAX, DATA_STATE, 200},
+    {HISTORY, false, 0, 0, DATA_UNKNOWN, 0}, // downloads are requested
+    {FAST, true, 0, 0, DATA_FAST, 20},
+};
+
+struct ChannelBuffers
+{
+  BLECharacteristic *characteristic;
+  BLE2902 *cccd;   // set if subscribing starts a stream
+  bool subscribed; // notifications enabled, BLE task only
+  JsonArena *arena;
+  JsonDocument *doc;
+  JsonDocument *delta;
+  uint8_t *output;
+  JsonArena *snapshotArena; // created by the first delta run
+  JsonDocument *snapshot;
+};
+
+static ChannelBuffers buffers[LINK_CHANNEL_COUNT] = {};
+
+// Allocate the channel arenas and buffers
+void initializeTelemetryChannels()
+{
+  for (int i = 0; i < LINK_CHANNEL_COUNT; i++)
+  {
+    const ChannelConfig &config = CHANNELS[i];
+    if (config.arenaSize == 0)
+      continue;
+
+    ChannelBuffers &channel = buffers[i];
+    channel.arena = new JsonArena(new uint8_t[config.arenaSize], config.arenaSize);
+    channel.doc = new JsonDocument(channel.arena);
+    channel.delta = new JsonDocument(channel.arena);
+    channel.output = new uint8_t[config.outputSize];
+  }
+}
+
+// Starts or stops a channel's stream when the client writes its CCCD
+class SubscriptionCallbacks : public BLEDescriptorCallbacks
+{
+public:
+  explicit SubscriptionCallbacks(LinkChannel channel) : channel(channel) {}
+
+  void onWrite(BLEDescriptor *descriptor) override
+  {
+    ChannelBuffers &buffer = buffers[channel];
+    bool enabled = buffer.cccd->getNotifications();
+
+    // Clients may rewrite the same value, only act on changes so a rate
+    // set by command is kept
+    if (enabled == buffer.subscribed)
+      return;
+    buffer.subscribed = enabled;
+
+    const ChannelConfig &config = CHANNELS[channel];
+    LOG_INFO(SUBSCRIPTION_CHANGED, config.name, enabled);
+    processSubscription(config.dataType, config.subscribeMs, enabled);
+  }
+
+private:
+  LinkChannel channel;
+};
+
+// Attach a channel's characteristic and register it with the notify sender
+void bindChannelCharacteristic(LinkChannel channel, BLECharacteristic *characteristic)
+{
+  buffers[channel].characteristic = characteristic;
+  registerNotifyCharacteristic(characteristic, CHANNELS[channel].name, CHANNELS[channel].mergeable);
+
+  if (CHANNELS[channel].dataType == DATA_UNKNOWN)
+    return;
+
+  BLEDescriptor *cccd = characteristic->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
+  if (cccd == nullptr)
+    return;
+  buffers[channel].cccd = static_cast<BLE2902 *>(cccd);
+  cccd->setCallbacks(new SubscriptionCallbacks(channel));
+}
+
+// Forget all subscriptions, their streams are stopped by the caller
+void clearChannelSubscriptions()
+{
+  for (int i = 0; i < LINK_CHANNEL_COUNT; i++)
+  {
+    ChannelBuffers &buffer = buffers[i];
+    buffer.subscribed = false;
+    if (buffer.cccd != nullptr)
+      buffer.cccd->setNotifications(false);
+  }
+}
+
+// Characteristic of a channel, nullptr if none is bound
+BLECharacteristic *channelCharacteristic(LinkChannel channel)
+{
+  return channel < LINK_CHANNEL_COUNT ? buffers[channel].characteristic : nullptr;
+}
+
+const char *channelName(LinkChannel channel)
+{
+  return CHANNELS[channel].name;
+}
+
+// Clear the channel's documents and rewind its arena
+void resetChannelDocuments(LinkChannel channel)
+{
+  ChannelBuffers &buffer = buffers[channel];
+  buffer.doc->clear();
+  buffer.delta->clear();
+  buffer.arena->reset();
+}
+
+JsonDocument &channelDocument(LinkChannel channel)
+{
+  return *buffers[channel].doc;
+}
+
+JsonDocument &channelDeltaDocument(LinkChannel channel)
+{
+  return *buffers[channel].delta;
+}
+
+// Snapshot document of a channel's delta stream
+JsonDocument &channelSnapshotDocument(LinkChannel channel)
+{
+  ChannelBuffers &buffer = buffers[channel];
+  if (buffer.snapshot == nullptr)
+  {
+    size_t size = CHANNELS[channel].arenaSize;
+    buffer.snapshotArena = new JsonArena(new uint8_t[size], size);
+    buffer.snapshot = new JsonDocument(buffer.snapshotArena);
+  }
+
+  // Updated values are not released by the arena, start over before it fills
+  if (buffer.snapshotArena->used() > buffer.snapshotArena->capacity() / 4 * 3)
+    resetChannelSnapshot(channel);
+  return *buffer.snapshot;
+}
+
+void resetChannelSnapshot(LinkChannel channel)
+{
+  ChannelBuffers &buffer = buffers[channel];
+  if (buffer.snapshot == nullptr)
+    return;
+  buffer.snapshot->clear();
+  buffer.snapshotArena->reset();
+}
+
+// Output buffer of a channel
+uint8_t *channelOutput(LinkChannel channel, size_t &capacity)
+{
+  capacity = CHANNELS[channel].outputSize;
+  return buffers[channel].output;
+}
+
+// Allocations that missed a channel arena
+uint32_t getChannelArenaMisses()
+{
+  uint32_t allocs = 0;
+  for (int i = 0; i < LINK_CHANNEL_COUNT; i++)
+  {
+    if (buffers[i].arena != nullptr)
+      allocs += buffers[i].arena->heapAllocs;
+    if (buffers[i].snapshotArena != nullptr)
+      allocs += buffers[i].snapshotArena->heapAllocs;
+  }
+  return allocs;
+}
@@ -0,0 +1,63 @@
+#ifndef TELEMETRY_CHANNEL_H
+#define TELEMETRY_CHANNEL_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <BLECharacteristic.h>
+#include "configs.h"
+#include "usb_link.h"
+
+// ======================================================================
+// Telemetry Channels
+// ======================================================================
+// Table of outgoing channels indexed by LinkChannel. Each channel owns its
+// notify characteristic, a JsonArena backing a read document and a delta
+// document, and a fixed output buffer. Delta streams add a snapshot
+// document with an arena of the same size. All of it is allocated once by
+// initializeTelemetryChannels, sends look the channel up by index.
+//
+// Channels with a default stream start it when the client enables
+// notifications on their characteristic and stop it when they are
+// disabled, so nothing is polled that no client reads. A receiveContinuous
+// command still sets a different rate or options.
+//
+// The documents and output buffer belong to the telemetry task. Other
+// tasks send through sendDocument, which serializes on the stack.
+
+// Allocate the channel arenas and buffers
+void initializeTelemetryChannels();
+
+// Attach a channel's characteristic and register it with the notify sender
+void bindChannelCharacteristic(LinkChannel channel, BLECharacteristic *characteristic);
+
+// Forget all subscriptions, their streams are stopped by the caller
+void clearChannelSubscriptions();
+
+// Characteristic of a channel, nullptr if none is bound
+BLECharacteristic *channelCharacteristic(LinkChannel channel);
+
+const char *channelName(LinkChannel channel);
+
+// Clear the channel's documents and rewind its arena, telemetry task only
+void resetChannelDocuments(LinkChannel channel);
+
+// Read and delta documents of a channel, telemetry task only
+JsonDocument &channelDocument(LinkChannel channel);
+JsonDocument &channelDeltaDocument(LinkChannel channel);
+
+// Last values sent by the channel's delta stream, telemetry task only.
+// Kept in an arena of its own, allocated on the first delta run. When the
+// arena is three quarters full the snapshot starts over and the next delta
+// carries every field.
+JsonDocument &channelSnapshotDocument(LinkChannel channel);
+
+// Forget the delta snapshot, telemetry task only
+void resetChannelSnapshot(LinkChannel channel);
+
+// Output buffer of a channel, telemetry task only
+uint8_t *channelOutput(LinkChannel channel, size_t &capacity);
+
+// Allocations that missed a channel arena, should stay at zero
+uint32_t getChannelArenaMisses();
+
+#endif // TELEMETRY_CHANNEL_H
@@ -0,0 +1,130 @@
+#include "telemetry_delta.h"
+#include "token_hash.h"
+
+static constexpr const char *DEADBAND_NAMES[DEADBAND_COUNT] = {
+    "angle",
+    "speed",
+    "load",
+    "temp",
+    "voltage",
+    "current",
+    "soc",
+    "distance",
+};
+
+static const float DEFAULT_DEADBANDS[DEADBAND_COUNT] = {
+    0.5,  // angle, degrees
+    10,   // speed, steps/s
+    20,   // load, 0.1%
+    1,    // temp, C
+    0.1,  // voltage, V
+    0.1,  // current, A
+    1,    // soc, %
+    1,    // distance
+};
+
+static constexpr TokenTable<DEADBAND_COUNT, 16> DEADBAND_TABLE(DEADBAND_NAMES);
+static_assert(DEADBAND_TABLE.valid(), "no perfect hash for deadband fields");
+
+// Deadband field of a key, -1 if any change is sent
+int deadbandFieldFor(const char *key)
+{
+  return DEADBAND_TABLE.find(key);
+}
+
+void setDefaultDeadbands(Deadbands &deadbands)
+{
+  memcpy(deadbands.value, DEFAULT_DEADBANDS, sizeof(deadbands.value));
+}
+
+// Override deadbands from a {"field": value} object
+void parseDeadbands(JsonObjectConst source, Deadbands &deadbands)
+{
+  for (JsonPairConst kv : source)
+  {
+    int field = deadbandFieldFor(kv.key().c_str());
+    if (field >= 0 && kv.value().is<float>())
+      deadbands.value[field] = fabsf(kv.value().as<float>());
+  }
+}
+
+// True if a value moved beyond the deadband of its key
+static bool fieldChanged(const char *key, JsonVariantConst value, JsonVariantConst previous,
+                         const Deadbands &deadbands)
+{
+  if (previous.isNull())
+    return true;
+
+  if (value.is<float>() && previous.is<float>())
+  {
+    int field = deadbandFieldFor(key);
+    float delta = fabsf(value.as<float>() - previous.as<float>());
+    return field < 0 ? delta != 0 : delta > deadbands.value[field];
+  }
+
+  return value != previous;
+}
+
+// Copy the fields of current that moved beyond their deadband into out and
+// record them in snapshot
+int diffTelemetryDocument(JsonObjectConst current, JsonObject snapshot, JsonObject out,
+                          const Deadbands &deadbands, bool keyframe)
+{
+  int changed = 0;
+
+  for (JsonPairConst kv : current)
+  {
+    const char *key = kv.key().c_str();
+    JsonVariantConst value = kv.value();
+
+    if (value.is<JsonObjectConst>())
+    {
+      JsonObject snapshotChild = snapshot[key].is<JsonObject>() ? snapshot[key].as<JsonObject>()
+                                                                : snapshot[key].to<JsonObject>();
+      JsonObject outChild = out[key].to<JsonObject>();
+      int childChanged = diffTelemetryDocument(value.as<JsonObjectConst>(), snapshotChild, outChild,
+                                               deadbands, keyframe);
+      if (childChanged == 0)
+        out.remove(key);
+      changed += childChanged;
+    }
+    else if (keyframe || fieldChanged(key, value, snapshot[key], deadbands))
+    {
+      out[key] = value;
+      snapshot[key] = value;
+      changed++;
+    }
+  }
+
+  return changed;
+}
+
+// Servos of mask whose feedback moved beyond the deadbands
+uint16_t diffServoFeedback(uint16_t mask, const ServoFeedback *current, ServoFeedback *snapshot,
+                           const Deadbands &deadbands, bool keyframe)
+{
+  uint16_t changed = 0;
+
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    if (!(mask & (1 << i)))
+      continue;
+
+    const ServoFeedback &now = current[i];
+    const ServoFeedback &last = snapshot[i];
+    bool moved = keyframe ||
+                 now.status != last.status ||
+                 abs(now.position - last.position) * (360.0f / 4096) > deadbands.value[DEADBAND_ANGLE] ||
+                 abs(now.speed - last.speed) > deadbands.value[DEADBAND_SPEED] ||
+                 abs(now.load - last.load) > deadbands.value[DEADBAND_LOAD] ||
+                 abs(now.temperature - last.temperature) > deadbands.value[DEADBAND_TEMP];
+
+    if (moved)
+    {
+      snapshot[i] = now;
+      changed |= 1 << i;
+    }
+  }
+
+  return changed;
+}
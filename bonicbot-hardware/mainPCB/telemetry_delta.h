@@ -0,0 +1,59 @@
+#ifndef TELEMETRY_DELTA_H
+#define TELEMETRY_DELTA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "configs.h"
+#include "servo_control.h"
+
+// ======================================================================
+// Change-only Telemetry
+// ======================================================================
+// A delta subscription keeps the last sent value of every field and only
+// sends fields that moved beyond their deadband since then. Fields without
+// a deadband are sent on any change. A run with no changes sends nothing,
+// and every keyframeEvery-th run is a keyframe carrying every field, so
+// late joiners and lost notifications recover.
+//
+// Deadbands are in the units of the document fields (degrees, %, ...) and
+// can be overridden per subscription with a "deadband" object keyed by
+// field name, e.g. {"angle": 0.5, "soc": 1}.
+
+enum DeadbandField : uint8_t
+{
+  DEADBAND_ANGLE,
+  DEADBAND_SPEED,
+  DEADBAND_LOAD,
+  DEADBAND_TEMP,
+  DEADBAND_VOLTAGE,
+  DEADBAND_CURRENT,
+  DEADBAND_SOC,
+  DEADBAND_DISTANCE,
+  DEADBAND_COUNT,
+};
+
+struct Deadbands
+{
+  float value[DEADBAND_COUNT];
+};
+
+// Deadband field of a key, -1 if any change is sent
+int deadbandFieldFor(const char *key);
+
+void setDefaultDeadbands(Deadbands &deadbands);
+
+// Override deadbands from a {"field": value} object
+void parseDeadbands(JsonObjectConst source, Deadbands &deadbands);
+
+// Copy the fields of current that moved beyond their deadband into out and
+// record them in snapshot, a keyframe copies every field. Returns the
+// number of fields copied.
+int diffTelemetryDocument(JsonObjectConst current, JsonObject snapshot, JsonObject out,
+                          const Deadbands &deadbands, bool keyframe);
+
+// Servos of mask whose feedback moved beyond the deadbands, their snapshot
+// records are updated. A keyframe returns mask.
+uint16_t diffServoFeedback(uint16_t mask, const ServoFeedback *current, ServoFeedback *snapshot,
+                           const Deadbands &deadbands, bool keyframe);
+
+#endif // TELEMETRY_DELTA_H
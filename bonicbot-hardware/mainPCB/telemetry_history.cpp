@@ -0,0 +1,234 @@
+#include "telemetry_history.h"
+#include <esp_heap_caps.h>
+#include "communication.h"
+#include "servo_bus.h"
+
+static portMUX_TYPE historyLock = portMUX_INITIALIZER_UNLOCKED;
+static HistorySample *ring = nullptr;
+static uint32_t capacity = 0;
+static uint32_t written = 0; // samples written since boot, next at written % capacity
+static bool ringInPsram = false;
+static uint32_t downloads = 0;
+
+// Sample reads go through the bus queue, never ahead of servo writes
+static ServoTransaction historyRead;
+
+static TaskHandle_t historyTaskHandle = nullptr;
+static uint32_t requestedFrom = 0;
+static uint32_t requestedTo = 0;
+
+// Timestamp of a sample still in the ring
+static uint32_t sampleTime(uint32_t n)
+{
+  portENTER_CRITICAL(&historyLock);
+  uint32_t timestamp = ring[n % capacity].timestamp;
+  portEXIT_CRITICAL(&historyLock);
+  return timestamp;
+}
+
+// First sample in [begin, end) recorded at or after time
+static uint32_t lowerBound(uint32_t begin, uint32_t end, uint32_t time)
+{
+  while (begin < end)
+  {
+    uint32_t mid = begin + (end - begin) / 2;
+    if ((int32_t)(sampleTime(mid) - time) < 0)
+      begin = mid + 1;
+    else
+      end = mid;
+  }
+  return begin;
+}
+
+// Payload bytes one chunk may use on the slowest channel. The MTU only
+// counts while a BLE client is connected, USB packets carry 4 bytes of
+// type, channel and CRC.
+static size_t chunkPayloadSize()
+{
+#if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
+  if (deviceConnected)
+    return connectionMtu - 3;
+#endif
+  return USB_LINK_MAX_PACKET - 4;
+}
+
+// Stream the samples of a window in chunks
+static void downloadWindow(uint32_t fromMs, uint32_t toMs)
+{
+  static uint8_t chunk[USB_LINK_MAX_PACKET - 4];
+  size_t payload = min(chunkPayloadSize(), sizeof(chunk));
+  uint32_t perChunk = payload > HISTORY_CHUNK_HEADER_SIZE
+                          ? (payload - HISTORY_CHUNK_HEADER_SIZE) / sizeof(HistorySample)
+                          : 0;
+  if (perChunk == 0)
+  {
+    // Default 23 byte MTU, not one sample fits a notification
+    sendStatus("history needs a larger MTU");
+    return;
+  }
+
+  portENTER_CRITICAL(&historyLock);
+  uint32_t end = written;
+  portEXIT_CRITICAL(&historyLock);
+
+  uint32_t oldest = end > capacity ? end - capacity : 0;
+  uint32_t first = lowerBound(oldest, end, fromMs);
+  end = lowerBound(first, end, toMs + 1);
+
+  uint32_t total = end - first;
+  uint32_t chunks = (total + perChunk - 1) / perChunk;
+  uint16_t chunkCount = chunks == 0 ? 1 : chunks;
+
+  for (uint16_t c = 0; c < chunkCount; c++)
+  {
+#if COMM_METHOD == COMM_METHOD_BLE
+    if (!deviceConnected)
+      return;
+#endif
+
+    uint32_t n = first + c * perChunk;
+    uint32_t chunkEnd = n + perChunk;
+    if (chunkEnd > end)
+      chunkEnd = end;
+    uint16_t samples = 0;
+    uint8_t *p = chunk + HISTORY_CHUNK_HEADER_SIZE;
+
+    for (; n < chunkEnd; n++)
+    {
+      portENTER_CRITICAL(&historyLock);
+      bool valid = written - n <= capacity;
+      if (valid)
+        memcpy(p, &ring[n % capacity], sizeof(HistorySample));
+      portEXIT_CRITICAL(&historyLock);
+
+      if (valid)
+      {
+        p += sizeof(HistorySample);
+        samples++;
+      }
+    }
+
+    chunk[0] = HISTORY_MAGIC;
+    chunk[1] = sizeof(HistorySample);
+    chunk[2] = c & 0xFF;
+    chunk[3] = c >> 8;
+    chunk[4] = chunkCount & 0xFF;
+    chunk[5] = chunkCount >> 8;
+    chunk[6] = samples & 0xFF;
+    chunk[7] = samples >> 8;
+    sendResponse(chunk, p - chunk, LINK_CHANNEL_HISTORY);
+
+#if COMM_METHOD == COMM_METHOD_BLE || COMM_METHOD == COMM_METHOD_BOTH
+    // Next chunk as soon as the stack took this one
+    waitNotifyIdle(historyChar, NOTIFY_INFLIGHT_TIMEOUT_MS);
+#endif
+  }
+
+  LOG_INFO(HISTORY_SENT, total);
+}
+
+static void historyTask(void *param)
+{
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    portENTER_CRITICAL(&historyLock);
+    uint32_t fromMs = requestedFrom;
+    uint32_t toMs = requestedTo;
+    portEXIT_CRITICAL(&historyLock);
+
+    downloadWindow(fromMs, toMs);
+
+    portENTER_CRITICAL(&historyLock);
+    downloads++;
+    portEXIT_CRITICAL(&historyLock);
+  }
+}
+
+// Allocate the ring and start the download task
+void initializeHistory()
+{
+  initServoTransaction(historyRead, SERVO_TRANSACTION_FEEDBACK);
+  historyRead.mask = ALL_SERVOS_MASK;
+  historyRead.ioTimeoutUs = HISTORY_IO_TIMEOUT_US;
+
+  if (psramFound())
+  {
+    ring = (HistorySample *)heap_caps_malloc(HISTORY_SAMPLES * sizeof(HistorySample),
+                                             MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    capacity = HISTORY_SAMPLES;
+    ringInPsram = ring != nullptr;
+  }
+  if (ring == nullptr)
+  {
+    ring = (HistorySample *)heap_caps_malloc(HISTORY_FALLBACK_SAMPLES * sizeof(HistorySample),
+                                             MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    capacity = HISTORY_FALLBACK_SAMPLES;
+  }
+  if (ring == nullptr)
+  {
+    capacity = 0;
+    LOG_ERROR(HISTORY_ALLOC_FAILED);
+    return;
+  }
+
+  xTaskCreatePinnedToCore(historyTask, "history", HISTORY_TASK_STACK, nullptr,
+                          HISTORY_TASK_PRIORITY, &historyTaskHandle, HISTORY_TASK_CORE);
+
+  LOG_INFO(HISTORY_READY, capacity, ringInPsram);
+}
+
+// Read the servos and battery into the next sample, telemetry task only
+bool recordHistorySample()
+{
+  if (ring == nullptr)
+    return false;
+
+  if (!submitServoTransaction(historyRead))
+    return false;
+  waitServoTransaction(historyRead);
+  const ServoFeedback *feedback = historyRead.feedback;
+
+  HistorySample sample;
+  sample.timestamp = millis();
+  sample.noResponse = 0;
+  for (int i = 0; i < TOTAL_SERVOS; i++)
+  {
+    sample.position[i] = feedback[i].position;
+    sample.load[i] = feedback[i].load;
+    if (feedback[i].status & SERVO_STATUS_NO_RESPONSE)
+      sample.noResponse |= 1 << i;
+  }
+  sample.batteryCurrent = lroundf(getBatteryCurrent() * 100);
+
+  portENTER_CRITICAL(&historyLock);
+  ring[written % capacity] = sample;
+  written++;
+  portEXIT_CRITICAL(&historyLock);
+  return true;
+}
+
+// Stream the samples recorded in [fromMs, toMs]
+void requestHistoryDownload(uint32_t fromMs, uint32_t toMs)
+{
+  if (historyTaskHandle == nullptr)
+    return;
+
+  portENTER_CRITICAL(&historyLock);
+  requestedFrom = fromMs;
+  requestedTo = toMs;
+  portEXIT_CRITICAL(&historyLock);
+
+  xTaskNotifyGive(historyTaskHandle);
+}
+
+void getHistoryStats(HistoryStats &stats)
+{
+  portENTER_CRITICAL(&historyLock);
+  stats.capacity = capacity;
+  stats.recorded = written;
+  stats.psram = ringInPsram;
+  stats.downloads = downloads;
+  portEXIT_CRITICAL(&historyLock);
+}
@@ -0,0 +1,67 @@
+#ifndef TELEMETRY_HISTORY_H
+#define TELEMETRY_HISTORY_H
+
+#include <Arduino.h>
+#include "configs.h"
+
+// ======================================================================
+// Telemetry History
+// ======================================================================
+// Fixed ring of packed samples for tuning traces, HISTORY_SAMPLES long in
+// PSRAM, HISTORY_FALLBACK_SAMPLES in internal RAM on boards without it.
+// The ring is allocated once at startup.
+//
+// Recording is the "history" telemetry stream: receiveContinuous with an
+// interval down to HISTORY_MIN_INTERVAL_MS starts it, stopReceive stops
+// it. Each run the telemetry task queues one sync read on the servo bus
+// (servo_bus.h) with HISTORY_IO_TIMEOUT_US per servo, so servo writes go
+// out around it, and writes the sample under a short spinlock. Servos that
+// did not answer in time are flagged in noResponse. A run that finds the
+// bus queue full records nothing and counts as suppressed.
+//
+// receiveSingle on "history" with optional payload "from" and "to"
+// (millis(), default the whole ring) streams that window from a low
+// priority task on the history characteristic / USB channel, as fast as
+// the link takes it. Each chunk, little endian:
+//   [0]    HISTORY_MAGIC
+//   [1]    sample size in bytes
+//   [2..3] u16 chunk index
+//   [4..5] u16 chunk count of this download
+//   [6..7] u16 samples in this chunk
+// followed by the samples. Samples overwritten while the download runs
+// are left out, an empty window sends one chunk without samples.
+
+#define HISTORY_MAGIC 0xE1
+#define HISTORY_CHUNK_HEADER_SIZE 8
+
+struct __attribute__((packed)) HistorySample
+{
+  uint32_t timestamp;              // millis()
+  int16_t position[TOTAL_SERVOS];  // raw steps
+  int16_t load[TOTAL_SERVOS];      // 0.1 %
+  int16_t batteryCurrent;          // 10 mA, last BMS reading
+  uint16_t noResponse;             // bit n set if servo n did not answer
+};
+
+static_assert(sizeof(HistorySample) == 64, "history sample layout changed");
+
+struct HistoryStats
+{
+  uint32_t capacity; // samples the ring holds
+  uint32_t recorded; // samples written since boot
+  bool psram;        // ring placed in PSRAM
+  uint32_t downloads;
+};
+
+// Allocate the ring and start the download task
+void initializeHistory();
+
+// Read the servos and battery into the next sample, telemetry task only
+bool recordHistorySample();
+
+// Stream the samples recorded in [fromMs, toMs]
+void requestHistoryDownload(uint32_t fromMs, uint32_t toMs);
+
+void getHistoryStats(HistoryStats &stats);
+
+#endif // TELEMETRY_HISTORY_H
@@ -0,0 +1,138 @@
+#ifndef TOKEN_HASH_H
+#define TOKEN_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ======================================================================
+// Compile-time perfect hash for protocol tokens
+// ======================================================================
+// A TokenTable is built by the compiler from a constexpr name list. Its
+// constructor searches for a seed that gives every name its own slot, so a
+// lookup is one hash, one slot read and one strcmp to reject unknown
+// tokens. Table index i is the position of the name in the list.
+//
+// Everything here is C++11 constexpr, one return statement per function,
+// so the header builds with -std=gnu++11 as well as later standards.
+
+// FNV-1a over the string
+constexpr uint32_t tokenFnv(const char *s, uint32_t h)
+{
+  return *s ? tokenFnv(s + 1, (h ^ (uint8_t)*s) * 16777619u) : h;
+}
+
+constexpr uint32_t tokenShift(uint32_t h, int shift)
+{
+  return h ^ (h >> shift);
+}
+
+// FNV-1a with the seed mixed into the offset basis, followed by a
+// murmur3 finalizer so the low bits used for the slot depend on every bit
+constexpr uint32_t tokenHash(const char *s, uint32_t seed)
+{
+  return tokenShift(tokenShift(tokenShift(tokenFnv(s, 2166136261u ^ (seed * 0x9E3779B9u)), 16) * 0x85EBCA6Bu, 13) * 0xC2B2AE35u, 16);
+}
+
+constexpr size_t tokenSlot(const char *s, uint32_t seed, size_t slots)
+{
+  return tokenHash(s, seed) & (slots - 1);
+}
+
+// True if name i shares no slot with names j and later
+constexpr bool tokenAlone(const char *const *names, size_t n, size_t slots, uint32_t seed, size_t i, size_t j)
+{
+  return j >= n || (tokenSlot(names[i], seed, slots) != tokenSlot(names[j], seed, slots) &&
+                    tokenAlone(names, n, slots, seed, i, j + 1));
+}
+
+// True if the seed gives names i and later a slot each
+constexpr bool tokenPerfect(const char *const *names, size_t n, size_t slots, uint32_t seed, size_t i)
+{
+  return i >= n || (tokenAlone(names, n, slots, seed, i, i + 1) &&
+                    tokenPerfect(names, n, slots, seed, i + 1));
+}
+
+// First perfect seed in [first, last), 0 if none. The range is split in
+// halves so the recursion stays shallow.
+constexpr uint32_t tokenSeed(const char *const *names, size_t n, size_t slots, uint32_t first, uint32_t last);
+
+constexpr uint32_t tokenSeedOr(uint32_t found, const char *const *names, size_t n, size_t slots, uint32_t first, uint32_t last)
+{
+  return found != 0 ? found : tokenSeed(names, n, slots, first, last);
+}
+
+constexpr uint32_t tokenSeed(const char *const *names, size_t n, size_t slots, uint32_t first, uint32_t last)
+{
+  return last - first == 1
+             ? (tokenPerfect(names, n, slots, first, 0) ? first : 0)
+             : tokenSeedOr(tokenSeed(names, n, slots, first, first + (last - first) / 2),
+                           names, n, slots, first + (last - first) / 2, last);
+}
+
+// Index of the name in the slot, -1 for an empty slot
+constexpr int8_t tokenInSlot(const char *const *names, size_t n, size_t slots, uint32_t seed, size_t slot, size_t i)
+{
+  return i >= n ? -1
+                : tokenSlot(names[i], seed, slots) == slot ? (int8_t)i
+                                                           : tokenInSlot(names, n, slots, seed, slot, i + 1);
+}
+
+// Slot numbers 0..SLOTS-1 as a parameter pack
+template <size_t... I>
+struct TokenSlotList
+{
+};
+
+template <size_t SLOTS, size_t... I>
+struct MakeTokenSlotList : MakeTokenSlotList<SLOTS - 1, SLOTS - 1, I...>
+{
+};
+
+template <size_t... I>
+struct MakeTokenSlotList<0, I...>
+{
+  typedef TokenSlotList<I...> type;
+};
+
+template <size_t N, size_t SLOTS>
+class TokenTable
+{
+  static_assert((SLOTS & (SLOTS - 1)) == 0, "SLOTS must be a power of two");
+  static_assert(N < SLOTS && N < 128, "too many tokens for the table");
+
+public:
+  constexpr TokenTable(const char *const (&names)[N])
+      : TokenTable(names, tokenSeed(names, N, SLOTS, 1, 100000),
+                   typename MakeTokenSlotList<SLOTS>::type())
+  {
+  }
+
+  // True once a collision-free seed was found
+  constexpr bool valid() const { return seed_ != 0; }
+
+  // Index of the token in the name list, -1 if unknown or null
+  int find(const char *token) const
+  {
+    if (token == nullptr)
+      return -1;
+
+    int index = slots_[tokenSlot(token, seed_, SLOTS)];
+    if (index < 0 || strcmp(token, names_[index]) != 0)
+      return -1;
+    return index;
+  }
+
+private:
+  template <size_t... I>
+  constexpr TokenTable(const char *const (&names)[N], uint32_t seed, TokenSlotList<I...>)
+      : names_(names), seed_(seed), slots_{(seed != 0 ? tokenInSlot(names, N, SLOTS, seed, I, 0) : (int8_t)-1)...}
+  {
+  }
+
+  const char *const *names_;
+  uint32_t seed_;
+  int8_t slots_[SLOTS];
+};
+
+#endif // TOKEN_HASH_H
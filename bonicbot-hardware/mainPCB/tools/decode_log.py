@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Decode mainPCB log records from the USB serial port.
+
+The firmware sends debug_log.h records as LINK_TYPE_LOG packets on the USB
+link (COBS framed, CRC-16/CCITT-FALSE). The format strings live in
+log_messages.h, which this script reads so both always agree.
+
+    decode_log.py /dev/ttyACM0          # read a serial port (needs pyserial)
+    decode_log.py capture.bin           # decode a raw capture
+    decode_log.py - < capture.bin       # decode stdin
+
+Text that is not inside a packet, like the ROM boot messages, is printed
+as it arrives.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+LINK_TYPE_LOG = 0x03
+LEVELS = {1: "ERROR", 2: "WARN", 3: "INFO", 4: "DEBUG"}
+CONVERSION = re.compile(r"%(\.\d+)?([dufxs%])")
+
+
+def load_messages(path):
+    """Message formats in id order, as the LogMessage enum assigns them."""
+    pattern = re.compile(r'^LOG_MESSAGE\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', re.M)
+    with open(path) as f:
+        return [(name, fmt.encode().decode("unicode_escape"))
+                for name, fmt in pattern.findall(f.read())]
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            return None
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def format_record(fmt, args):
+    """Expand a printf style format, reading arguments from the record."""
+    offset = 0
+
+    def expand(match):
+        nonlocal offset
+        precision, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        if conversion == "s":
+            if offset >= len(args):
+                return "?"
+            n = args[offset]
+            text = args[offset + 1:offset + 1 + n].decode("utf-8", "replace")
+            offset += 1 + n
+            return text
+        if offset + 4 > len(args):
+            return "?"
+        word = args[offset:offset + 4]
+        offset += 4
+        if conversion == "f":
+            return ("%" + (precision or "") + "f") % struct.unpack("<f", word)[0]
+        if conversion == "d":
+            return str(struct.unpack("<i", word)[0])
+        if conversion == "x":
+            return "%x" % struct.unpack("<I", word)[0]
+        return str(struct.unpack("<I", word)[0])
+
+    return CONVERSION.sub(expand, fmt)
+
+
+def decode_record(payload, messages):
+    if len(payload) < 7:
+        return None
+    level, message, timestamp = struct.unpack_from("<BHI", payload)
+    if message < len(messages):
+        name, fmt = messages[message]
+        if name == "SUPPRESSED" and len(payload) >= 15:
+            count, suppressed = struct.unpack_from("<II", payload, 7)
+            if suppressed < len(messages):
+                return "%10u %-5s %u records of %s suppressed" % (
+                    timestamp, LEVELS.get(level, level), count, messages[suppressed][0])
+        text = format_record(fmt, payload[7:])
+    else:
+        text = "unknown message %u" % message
+    return "%10u %-5s %s" % (timestamp, LEVELS.get(level, level), text)
+
+
+def handle_frame(frame, messages, out):
+    packet = cobs_decode(frame)
+    valid = (packet is not None and len(packet) >= 4 and
+             crc16(packet[:-2]) == struct.unpack("<H", packet[-2:])[0])
+    if not valid:
+        # Plain text written outside the link
+        out.write(frame.decode("utf-8", "replace"))
+        return
+    if packet[0] == LINK_TYPE_LOG:
+        line = decode_record(packet[2:-2], messages)
+        if line is not None:
+            out.write(line + "\n")
+    out.flush()
+
+
+def open_input(source):
+    if source == "-":
+        return sys.stdin.buffer
+    if os.path.isfile(source):
+        return open(source, "rb")
+    import serial  # pyserial, only needed for a live port
+    return serial.Serial(source, 115200, timeout=0.1)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source", help="serial port, capture file or - for stdin")
+    parser.add_argument("--messages", default=os.path.join(here, "..", "log_messages.h"),
+                        help="path to log_messages.h")
+    args = parser.parse_args()
+
+    messages = load_messages(args.messages)
+    stream = open_input(args.source)
+    pending = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            if stream is sys.stdin.buffer or not hasattr(stream, "in_waiting"):
+                break
+            continue
+        pending += chunk
+        while True:
+            end = pending.find(b"\0")
+            if end < 0:
+                break
+            if end > 0:
+                handle_frame(bytes(pending[:end]), messages, sys.stdout)
+            del pending[:end + 1]
+
+
+if __name__ == "__main__":
+    main()
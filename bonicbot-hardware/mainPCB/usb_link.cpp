@@ -0,0 +1,207 @@
+#include "usb_link.h"
+#include "communication.h"
+#include "debug_log.h"
+
+// COBS adds one byte per 254, plus the two delimiters
+#define USB_LINK_MAX_ENCODED (USB_LINK_MAX_PACKET + USB_LINK_MAX_PACKET / 254 + 3)
+
+// Encoded bytes of the packet being received, decoded in place
+static uint8_t rxBuffer[USB_LINK_MAX_ENCODED];
+static size_t rxLen = 0;
+static bool rxOverflow = false;
+
+// Packet assembly, guarded by txLock
+static SemaphoreHandle_t txLock = nullptr;
+static uint8_t txPacket[USB_LINK_MAX_PACKET];
+static uint8_t txEncoded[USB_LINK_MAX_ENCODED];
+
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+static UsbLinkStats stats = {};
+
+static uint16_t crc16(const uint8_t *data, size_t len)
+{
+  uint16_t crc = 0xFFFF;
+  while (len--)
+  {
+    crc ^= (uint16_t)*data++ << 8;
+    for (int i = 0; i < 8; i++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// COBS encode, out must hold len + len / 254 + 1 bytes
+static size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out)
+{
+  size_t write = 1;
+  size_t codeIndex = 0;
+  uint8_t code = 1;
+
+  for (size_t read = 0; read < len; read++)
+  {
+    if (in[read] == 0)
+    {
+      out[codeIndex] = code;
+      code = 1;
+      codeIndex = write++;
+      continue;
+    }
+
+    out[write++] = in[read];
+    if (++code == 0xFF)
+    {
+      out[codeIndex] = code;
+      code = 1;
+      codeIndex = write++;
+    }
+  }
+  out[codeIndex] = code;
+  return write;
+}
+
+// COBS decode in place, returns 0 for malformed input
+static size_t cobsDecode(uint8_t *buf, size_t len)
+{
+  size_t read = 0;
+  size_t write = 0;
+
+  while (read < len)
+  {
+    uint8_t code = buf[read++];
+    if (code == 0 || read + code - 1 > len)
+      return 0;
+    for (uint8_t i = 1; i < code; i++)
+      buf[write++] = buf[read++];
+    if (code < 0xFF && read < len)
+      buf[write++] = 0;
+  }
+  return write;
+}
+
+static void handlePacket(uint8_t *encoded, size_t encodedLen)
+{
+  size_t len = cobsDecode(encoded, encodedLen);
+  if (len < 4 || crc16(encoded, len - 2) != (uint16_t)(encoded[len - 2] | (encoded[len - 1] << 8)))
+  {
+    portENTER_CRITICAL(&statsLock);
+    stats.crcErrors++;
+    portEXIT_CRITICAL(&statsLock);
+    return;
+  }
+
+  portENTER_CRITICAL(&statsLock);
+  stats.rxPackets++;
+  portEXIT_CRITICAL(&statsLock);
+
+  if (encoded[0] == LINK_TYPE_COMMAND)
+    processCommand(encoded + 2, len - 4);
+}
+
+// Feed received bytes to the packet decoder
+void usbLinkFeed(const uint8_t *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    uint8_t c = data[i];
+    if (c == 0)
+    {
+      if (rxOverflow)
+      {
+        portENTER_CRITICAL(&statsLock);
+        stats.overflows++;
+        portEXIT_CRITICAL(&statsLock);
+      }
+      else if (rxLen > 0)
+      {
+        handlePacket(rxBuffer, rxLen);
+      }
+      rxLen = 0;
+      rxOverflow = false;
+    }
+    else if (rxLen < sizeof(rxBuffer))
+    {
+      rxBuffer[rxLen++] = c;
+    }
+    else
+    {
+      rxOverflow = true;
+    }
+  }
+}
+
+#if COMM_METHOD == COMM_METHOD_SERIAL || COMM_METHOD == COMM_METHOD_BOTH
+// Drain everything the RX event announced
+static void drainSerial()
+{
+  uint8_t chunk[64];
+  int available;
+  while ((available = Serial.available()) > 0)
+  {
+    size_t n = Serial.read(chunk, available < (int)sizeof(chunk) ? available : sizeof(chunk));
+    usbLinkFeed(chunk, n);
+  }
+}
+
+#if ARDUINO_USB_CDC_ON_BOOT
+static void onLinkRxEvent(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+  drainSerial();
+}
+#endif
+#endif
+
+// Prepare sending and, with SERIAL or BOTH, register the RX event
+// handler. Serial must already be started.
+void initializeUsbLink()
+{
+  txLock = xSemaphoreCreateMutex();
+
+#if COMM_METHOD == COMM_METHOD_SERIAL || COMM_METHOD == COMM_METHOD_BOTH
+#if ARDUINO_USB_CDC_ON_BOOT && ARDUINO_USB_MODE
+  Serial.onEvent(ARDUINO_HW_CDC_RX_EVENT, onLinkRxEvent);
+#elif ARDUINO_USB_CDC_ON_BOOT
+  Serial.onEvent(ARDUINO_USB_CDC_RX_EVENT, onLinkRxEvent);
+#else
+  Serial.onReceive(drainSerial);
+#endif
+
+  LOG_INFO(USB_LINK_READY);
+#endif
+}
+
+// Send one packet with a single Serial write
+bool usbLinkSend(uint8_t type, LinkChannel channel, const uint8_t *payload, size_t len)
+{
+  if (txLock == nullptr || len + 4 > sizeof(txPacket))
+    return false;
+
+  xSemaphoreTake(txLock, portMAX_DELAY);
+
+  txPacket[0] = type;
+  txPacket[1] = channel;
+  memcpy(txPacket + 2, payload, len);
+  uint16_t crc = crc16(txPacket, len + 2);
+  txPacket[len + 2] = crc & 0xFF;
+  txPacket[len + 3] = crc >> 8;
+
+  // Leading delimiter flushes any debug text the host has buffered
+  txEncoded[0] = 0;
+  size_t encodedLen = cobsEncode(txPacket, len + 4, txEncoded + 1);
+  txEncoded[encodedLen + 1] = 0;
+  Serial.write(txEncoded, encodedLen + 2);
+
+  xSemaphoreGive(txLock);
+
+  portENTER_CRITICAL(&statsLock);
+  stats.txPackets++;
+  portEXIT_CRITICAL(&statsLock);
+  return true;
+}
+
+// Snapshot of link statistics
+void getUsbLinkStats(UsbLinkStats &out)
+{
+  portENTER_CRITICAL(&statsLock);
+  out = stats;
+  portEXIT_CRITICAL(&statsLock);
+}
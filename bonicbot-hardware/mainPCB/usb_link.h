@@ -0,0 +1,75 @@
+#ifndef USB_LINK_H
+#define USB_LINK_H
+
+#include <Arduino.h>
+#include "configs.h"
+
+// ======================================================================
+// USB Link
+// ======================================================================
+// Framed binary transport on Serial (native USB-CDC on the ESP32-S3) for
+// COMM_METHOD_SERIAL and COMM_METHOD_BOTH. Each packet is COBS encoded and
+// sent between 0x00 delimiters, so a receiver resynchronises on the next
+// delimiter after noise or debug text.
+//
+// Decoded packet, little endian:
+//   [0]      type (LINK_TYPE_*)
+//   [1]      channel (LINK_CHANNEL_*, 0 for commands)
+//   [2..n-3] payload
+//   [n-2..]  CRC-16/CCITT-FALSE over bytes 0..n-3
+//
+// LINK_TYPE_COMMAND payloads are handed to processCommand unchanged, so
+// JSON, MessagePack and binary command frames work as on BLE. Telemetry
+// that BLE notifies on a characteristic is sent as LINK_TYPE_TELEMETRY on
+// the matching channel, in the negotiated encoding.
+//
+// Received bytes are fed from the Serial RX event, nothing polls in loop().
+//
+// LINK_TYPE_LOG packets carry debug_log.h records. They are sent with
+// every COMM_METHOD, with BLE only the link is transmit only and Serial
+// carries nothing else.
+
+#define LINK_TYPE_COMMAND 0x01
+#define LINK_TYPE_TELEMETRY 0x02
+#define LINK_TYPE_LOG 0x03
+
+enum LinkChannel : uint8_t
+{
+  LINK_CHANNEL_NONE = 0,
+  LINK_CHANNEL_BATTERY,
+  LINK_CHANNEL_DISTANCE,
+  LINK_CHANNEL_BASE,
+  LINK_CHANNEL_RIGHT_HAND,
+  LINK_CHANNEL_LEFT_HAND,
+  LINK_CHANNEL_HEAD,
+  LINK_CHANNEL_SERVO,
+  LINK_CHANNEL_ACK,
+  LINK_CHANNEL_DIAGNOSTICS,
+  LINK_CHANNEL_STATE,
+  LINK_CHANNEL_HISTORY,
+  LINK_CHANNEL_FAST,
+  LINK_CHANNEL_COUNT,
+};
+
+struct UsbLinkStats
+{
+  uint32_t rxPackets;  // valid packets received
+  uint32_t crcErrors;  // packets dropped for a bad CRC or COBS code
+  uint32_t overflows;  // packets dropped for exceeding USB_LINK_MAX_PACKET
+  uint32_t txPackets;  // packets sent
+};
+
+// Prepare sending and, with SERIAL or BOTH, register the RX event
+// handler. Serial must already be started.
+void initializeUsbLink();
+
+// Feed received bytes to the packet decoder
+void usbLinkFeed(const uint8_t *data, size_t len);
+
+// Send one packet with a single Serial write
+bool usbLinkSend(uint8_t type, LinkChannel channel, const uint8_t *payload, size_t len);
+
+// Snapshot of link statistics
+void getUsbLinkStats(UsbLinkStats &stats);
+
+#endif // USB_LINK_H
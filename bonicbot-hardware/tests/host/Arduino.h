@@ -0,0 +1,134 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// ======================================================================
+// Host Arduino Stub
+// ======================================================================
+// Just enough of the Arduino core to build libraries/SCServo with g++.
+// HardwareSerial is a half-duplex servo bus: every write hands the bytes
+// to onTx, which plays the servos and queues their replies with push.
+//
+// With byteUs set the bus keeps wire time. A write occupies the wire for
+// byteUs per byte after whatever is still going out, flush waits for the
+// wire to go idle, and a reply byte becomes readable only once it has
+// crossed the wire after the request. With byteUs 0 replies are readable
+// at once.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <functional>
+#include <vector>
+
+typedef uint8_t byte;
+class String; // declared only, for extern declarations in configs.h
+
+unsigned long millis();
+unsigned long micros();
+inline void yield() {}
+
+class HardwareSerial
+{
+public:
+  unsigned long byteUs = 0;      // wire time of one byte, 0 for none
+  unsigned long turnaroundUs = 30; // servo reply latency
+  std::function<void(std::vector<uint8_t> &tx, HardwareSerial &bus)> onTx;
+
+  // Counters for benchmarks
+  unsigned long writeCalls = 0;
+  unsigned long bytesWritten = 0;
+
+  int available()
+  {
+    int n = 0;
+    unsigned long now = micros();
+    for (const RxByte &r : rx)
+    {
+      if (r.at > now)
+        break;
+      n++;
+    }
+    return n;
+  }
+
+  int read()
+  {
+    if (rx.empty() || rx.front().at > micros())
+      return -1;
+    int c = rx.front().value;
+    rx.pop_front();
+    return c;
+  }
+
+  size_t readBytes(char *buffer, size_t length)
+  {
+    size_t n = 0;
+    int c;
+    while (n < length && (c = read()) >= 0)
+      buffer[n++] = (char)c;
+    return n;
+  }
+
+  size_t write(const uint8_t *data, size_t length)
+  {
+    writeCalls++;
+    bytesWritten += length;
+    if (byteUs != 0)
+    {
+      unsigned long now = micros();
+      if (wireFreeAt < now)
+        wireFreeAt = now;
+      wireFreeAt += length * byteUs;
+    }
+    if (onTx)
+    {
+      tx.insert(tx.end(), data, data + length);
+      onTx(tx, *this);
+    }
+    return length;
+  }
+
+  size_t write(uint8_t c) { return write(&c, 1); }
+
+  // Wait until every written byte is on the wire
+  void flush()
+  {
+    while (byteUs != 0 && micros() < wireFreeAt)
+      ;
+  }
+
+  // Queue one reply byte, readable after the request and the bytes before it
+  void push(uint8_t value)
+  {
+    unsigned long at = 0;
+    if (byteUs != 0)
+    {
+      at = wireFreeAt + turnaroundUs;
+      if (!rx.empty() && rx.back().at > at)
+        at = rx.back().at;
+      at += byteUs;
+    }
+    rx.push_back({value, at});
+  }
+
+  void clear()
+  {
+    rx.clear();
+    tx.clear();
+    wireFreeAt = 0;
+  }
+
+private:
+  struct RxByte
+  {
+    uint8_t value;
+    unsigned long at; // micros() when readable
+  };
+
+  std::deque<RxByte> rx;
+  std::vector<uint8_t> tx;
+  unsigned long wireFreeAt = 0;
+};
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,107 @@
+// ======================================================================
+// Instruction Frame Benchmark
+// ======================================================================
+// Time to build and send the frames the firmware sends most, and how many
+// UART write calls and bytes each takes. The frames are first sent to the
+// simulated servos, which must accept them and end up with the values
+// sent. The timed runs only count the bytes.
+//
+// Build against an older library to compare, see the Makefile.
+//
+//     frame_bench [iterations]   default 200000
+
+#include "servo_sim.h"
+#include "SMS_STS.h"
+#include <stdio.h>
+#include <chrono>
+
+static const int SERVOS = 14;
+
+static u8 ids[SERVOS];
+static s16 position[SERVOS];
+static u16 speed[SERVOS];
+static u8 acc[SERVOS];
+
+static void sendSyncWrite(SMS_STS &st, long n)
+{
+  for (int i = 0; i < SERVOS; i++)
+    position[i] = (n & 1) ? -i * 100 : i * 100;
+  st.SyncWritePosEx(ids, SERVOS, position, speed, acc);
+}
+
+static void sendSyncRead(SMS_STS &st, long)
+{
+  st.syncReadPacketTx(ids, SERVOS, SMS_STS_PRESENT_POSITION_L, 15);
+}
+
+static void sendWrite(SMS_STS &st, long n)
+{
+  st.WritePosEx(15, (n & 1) ? -100 : 100, 500, 50);
+}
+
+static void bench(SMS_STS &st, HardwareSerial &bus, const char *name,
+                  void (*send)(SMS_STS &, long), long iterations)
+{
+  bus.writeCalls = 0;
+  bus.bytesWritten = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (long n = 0; n < iterations; n++)
+    send(st, n);
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%-16s %8.1f %10.1f %8lu\n", name, ns / iterations,
+         (double)bus.writeCalls / iterations, bus.bytesWritten / iterations);
+}
+
+// Send each frame once to the simulated servos and check what they got
+static bool checkFrames(SMS_STS &st, HardwareSerial &bus)
+{
+  attachServoSim(bus);
+  sendSyncWrite(st, 1);
+  sendSyncRead(st, 0);
+  sendWrite(st, 0);
+
+  bool ok = servoSim.frames == 3 && servoSim.badFrames == 0;
+  for (int i = 0; i < SERVOS && ok; i++)
+  {
+    // Sent -i * 100, negative positions carry the sign in bit 15
+    const u8 *table = servoSim.table[ids[i]];
+    u16 stored = table[SMS_STS_GOAL_POSITION_L] | (table[SMS_STS_GOAL_POSITION_H] << 8);
+    ok = table[SMS_STS_ACC] == acc[i] && stored == (i == 0 ? 0 : (0x8000 | (i * 100)));
+  }
+  const u8 *single = servoSim.table[15];
+  ok = ok && (single[SMS_STS_GOAL_POSITION_L] | (single[SMS_STS_GOAL_POSITION_H] << 8)) == 100;
+
+  bus.onTx = nullptr;
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  long iterations = argc > 1 ? strtol(argv[1], nullptr, 10) : 200000;
+
+  HardwareSerial bus;
+  SMS_STS st;
+  st.begin(&bus, 1000000);
+  for (int i = 0; i < SERVOS; i++)
+  {
+    ids[i] = i + 1;
+    speed[i] = 500;
+    acc[i] = 50;
+  }
+
+  if (!checkFrames(st, bus))
+  {
+    printf("FAIL: the servos did not receive the frames sent\n");
+    return 1;
+  }
+
+  // Writes are not acknowledged, the timed runs get no replies
+  st.Level = 0;
+
+  printf("%-16s %8s %10s %8s\n", "frame", "ns", "writes", "bytes");
+  bench(st, bus, "SyncWritePosEx", sendSyncWrite, iterations);
+  bench(st, bus, "syncReadPacketTx", sendSyncRead, iterations);
+  bench(st, bus, "WritePosEx", sendWrite, iterations);
+  return 0;
+}
@@ -0,0 +1,103 @@
+// ======================================================================
+// Servo Bus Throughput
+// ======================================================================
+// Runs the control loop's bus pattern against simulated servos on a
+// 1 Mbaud wire: a sync write of 14 targets, caller work, then a sync read
+// of the same 14 servos. Checks that every servo that answers returns the
+// target just written and prints the cycle time. Replies missed because
+// the host preempted the test are counted but are not a failure.
+//
+// SCS::syncWrite used to wait for the frame to leave the UART. The
+// "blocking" run restores that wait with an explicit flush, the
+// "pipelined" run is the library as it is now: the caller works while
+// the write is still on the wire and the read queues behind it.
+//
+//     servo_bus_sim [work_us ...]   default 0 250 500 1000
+
+#include "servo_sim.h"
+#include "SMS_STS.h"
+#include <stdio.h>
+
+static const int SERVOS = 14;
+static const int CYCLES = 300;
+
+struct CycleResult
+{
+  unsigned long cycleUs;
+  int missed;     // replies not read in time
+  int mismatched; // replies that did not return the target
+};
+
+static CycleResult runCycles(bool blocking, unsigned long workUs)
+{
+  HardwareSerial bus;
+  bus.byteUs = 10;
+  attachServoSim(bus);
+
+  SMS_STS st;
+  st.begin(&bus, 1000000);
+  st.IOTimeOutUs = 500;
+
+  u8 ids[SERVOS];
+  s16 position[SERVOS];
+  u16 speed[SERVOS];
+  u8 acc[SERVOS];
+  SMS_STS_FeedBack feedback[SERVOS];
+  for (int i = 0; i < SERVOS; i++)
+  {
+    ids[i] = i + 1;
+    speed[i] = 0;
+    acc[i] = 0;
+  }
+
+  CycleResult result = {0, 0, 0};
+  unsigned long start = micros();
+  for (int cycle = 0; cycle < CYCLES; cycle++)
+  {
+    for (int i = 0; i < SERVOS; i++)
+      position[i] = 1000 + cycle + i;
+
+    st.SyncWritePosEx(ids, SERVOS, position, speed, acc);
+    if (blocking)
+      bus.flush();
+    busyWaitUs(workUs);
+
+    st.SyncFeedBack(ids, SERVOS, feedback);
+    for (int i = 0; i < SERVOS; i++)
+    {
+      if (feedback[i].Err)
+        result.missed++;
+      else if (feedback[i].Pos != 1000 + cycle + i)
+        result.mismatched++;
+    }
+  }
+  result.cycleUs = (micros() - start) / CYCLES;
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long defaultWork[] = {0, 250, 500, 1000};
+  int runs = argc > 1 ? argc - 1 : 4;
+  int missed = 0;
+  int failed = 0;
+
+  printf("%8s %12s %12s\n", "work us", "blocking us", "pipelined us");
+  for (int r = 0; r < runs; r++)
+  {
+    unsigned long workUs = argc > 1 ? strtoul(argv[r + 1], nullptr, 10) : defaultWork[r];
+    CycleResult blocking = runCycles(true, workUs);
+    CycleResult pipelined = runCycles(false, workUs);
+    printf("%8lu %12lu %12lu\n", workUs, blocking.cycleUs, pipelined.cycleUs);
+    missed += blocking.missed + pipelined.missed;
+    failed += blocking.mismatched + pipelined.mismatched;
+  }
+
+  if (failed != 0)
+  {
+    printf("FAIL: %d replies did not return the written target\n", failed);
+    return 1;
+  }
+  printf("ok, %d of %d replies missed\n", missed, runs * 2 * CYCLES * SERVOS);
+  return 0;
+}
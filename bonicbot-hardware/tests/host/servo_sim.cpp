@@ -0,0 +1,136 @@
+#include "servo_sim.h"
+#include "INST.h"
+#include <chrono>
+
+ServoSim servoSim;
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+unsigned long millis()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void busyWaitUs(unsigned long us)
+{
+  unsigned long start = micros();
+  while (micros() - start < us)
+    ;
+}
+
+// STS control table addresses the simulation cares about
+static const uint8_t GOAL_POSITION = 42;
+static const uint8_t PRESENT_POSITION = 56;
+
+static void reply(HardwareSerial &bus, uint8_t id, const uint8_t *data, uint8_t length)
+{
+  uint8_t sum = id + length + 2;
+  bus.push(0xff);
+  bus.push(0xff);
+  bus.push(id);
+  bus.push(length + 2);
+  bus.push(0);
+  for (int i = 0; i < length; i++)
+  {
+    bus.push(data[i]);
+    sum += data[i];
+  }
+  bus.push(id == servoSim.corruptId ? sum : (uint8_t)~sum);
+}
+
+static void writeTable(uint8_t id, uint8_t address, const uint8_t *data, size_t length)
+{
+  if (id >= SIM_SERVOS || address + length > SIM_TABLE)
+    return;
+  memcpy(&servoSim.table[id][address], data, length);
+  if (address <= GOAL_POSITION && address + length >= GOAL_POSITION + 2u)
+    memcpy(&servoSim.table[id][PRESENT_POSITION], &data[GOAL_POSITION - address], 2);
+}
+
+static bool answers(uint8_t id)
+{
+  return id < SIM_SERVOS && servoSim.alive[id];
+}
+
+static void runFrame(const std::vector<uint8_t> &frame, HardwareSerial &bus)
+{
+  size_t length = frame.size();
+  uint8_t sum = 0;
+  for (size_t i = 2; i < length - 1; i++)
+    sum += frame[i];
+  servoSim.frames++;
+  if ((uint8_t)~sum != frame[length - 1])
+  {
+    servoSim.badFrames++;
+    return;
+  }
+
+  uint8_t id = frame[2];
+  switch (frame[4])
+  {
+  case INST_PING:
+    if (answers(id))
+      reply(bus, id, nullptr, 0);
+    break;
+  case INST_READ:
+    if (answers(id))
+      reply(bus, id, &servoSim.table[id][frame[5]], frame[6]);
+    break;
+  case INST_WRITE:
+    writeTable(id, frame[5], &frame[6], length - 7);
+    if (answers(id) && id != 0xfe)
+      reply(bus, id, nullptr, 0);
+    break;
+  case INST_SYNC_WRITE:
+  {
+    uint8_t address = frame[5], n = frame[6];
+    for (size_t k = 7; k + n < length - 1; k += n + 1)
+      writeTable(frame[k], address, &frame[k + 1], n);
+    break;
+  }
+  case INST_SYNC_READ:
+  {
+    uint8_t address = frame[5], n = frame[6];
+    for (size_t k = 7; k < length - 1; k++)
+    {
+      if (answers(frame[k]))
+        reply(bus, frame[k], &servoSim.table[frame[k]][address], n);
+    }
+    break;
+  }
+  }
+}
+
+// Take every complete frame off the front of tx
+static void servoBus(std::vector<uint8_t> &tx, HardwareSerial &bus)
+{
+  while (tx.size() >= 4)
+  {
+    if (tx[0] != 0xff || tx[1] != 0xff)
+    {
+      tx.erase(tx.begin());
+      continue;
+    }
+    size_t length = tx[3] + 4;
+    if (tx.size() < length)
+      return;
+    std::vector<uint8_t> frame(tx.begin(), tx.begin() + length);
+    tx.erase(tx.begin(), tx.begin() + length);
+    runFrame(frame, bus);
+  }
+}
+
+void attachServoSim(HardwareSerial &bus)
+{
+  memset(&servoSim, 0, sizeof(servoSim));
+  for (int id = 0; id < SIM_SERVOS; id++)
+    servoSim.alive[id] = true;
+  servoSim.corruptId = -1;
+  bus.clear();
+  bus.onTx = servoBus;
+}
@@ -0,0 +1,35 @@
+#ifndef SERVO_SIM_H
+#define SERVO_SIM_H
+
+#include "Arduino.h"
+
+// ======================================================================
+// Simulated Servos
+// ======================================================================
+// A control table per servo id behind the stub bus. Instruction frames
+// are checked and applied the way an STS servo does: writes land in the
+// table, reads, pings and acked writes are answered from it. A write to
+// the goal position also moves the present position, so a read after a
+// write shows whether the write reached the servo.
+
+#define SIM_SERVOS 20
+#define SIM_TABLE 71
+
+struct ServoSim
+{
+  uint8_t table[SIM_SERVOS][SIM_TABLE];
+  bool alive[SIM_SERVOS]; // answers on the bus
+  int corruptId;          // replies of this id carry a bad checksum, -1 for none
+  unsigned long frames;   // instruction frames seen
+  unsigned long badFrames; // frames with a bad checksum
+};
+
+extern ServoSim servoSim;
+
+// Reset the servos to alive with an empty table and attach them to bus
+void attachServoSim(HardwareSerial &bus);
+
+// Spin for us microseconds, stands in for caller work
+void busyWaitUs(unsigned long us);
+
+#endif // SERVO_SIM_H
@@ -0,0 +1,118 @@
+// ======================================================================
+// SyncFeedBack Test
+// ======================================================================
+// SMS_STS::SyncFeedBack against simulated servos: decoding, silent
+// servos, bad replies, per-servo timeouts and the millisecond IOTimeOut. Exits non-zero on the first
+// failed check.
+
+#include "servo_sim.h"
+#include "SMS_STS.h"
+#include <stdio.h>
+
+static const int SERVOS = 14;
+static int failures = 0;
+
+#define CHECK(condition)                                            \
+  do                                                                \
+  {                                                                 \
+    if (!(condition))                                               \
+    {                                                               \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                   \
+    }                                                               \
+  } while (0)
+
+// Present position 2048, speed -10, load -5, 12.0 V, 35 C, moving, 3 mA
+static void fillTables()
+{
+  for (int id = 1; id <= SERVOS; id++)
+  {
+    u8 *table = servoSim.table[id];
+    table[SMS_STS_PRESENT_POSITION_L] = 0x00;
+    table[SMS_STS_PRESENT_POSITION_H] = 0x08;
+    table[SMS_STS_PRESENT_SPEED_L] = 10;
+    table[SMS_STS_PRESENT_SPEED_H] = 0x80;
+    table[SMS_STS_PRESENT_LOAD_L] = 5;
+    table[SMS_STS_PRESENT_LOAD_H] = 0x04;
+    table[SMS_STS_PRESENT_VOLTAGE] = 120;
+    table[SMS_STS_PRESENT_TEMPERATURE] = 35;
+    table[SMS_STS_MOVING] = 1;
+    table[SMS_STS_PRESENT_CURRENT_L] = 3;
+    table[SMS_STS_PRESENT_CURRENT_H] = 0;
+  }
+}
+
+int main()
+{
+  HardwareSerial bus;
+  SMS_STS st;
+  st.begin(&bus, 1000000);
+  st.IOTimeOutUs = 20000;
+
+  u8 ids[SERVOS];
+  u32 timeouts[SERVOS];
+  SMS_STS_FeedBack feedback[SERVOS];
+  for (int i = 0; i < SERVOS; i++)
+  {
+    ids[i] = i + 1;
+    timeouts[i] = 20000;
+  }
+
+  // Every servo answers
+  attachServoSim(bus);
+  fillTables();
+  CHECK(st.SyncFeedBack(ids, SERVOS, feedback) == SERVOS);
+  CHECK(st.getErr() == 0);
+  const SMS_STS_FeedBack &first = feedback[0];
+  CHECK(first.Err == 0 && first.Pos == 2048 && first.Speed == -10 && first.Load == -5);
+  CHECK(first.Voltage == 120 && first.Temper == 35 && first.Move == 1 && first.Current == 3);
+
+  // A silent servo leaves a gap, the servos after it are still decoded
+  servoSim.alive[5] = false;
+  CHECK(st.SyncFeedBack(ids, SERVOS, feedback) == SERVOS - 1);
+  CHECK(st.getErr() == 1);
+  CHECK(feedback[4].Err == 1 && feedback[3].Err == 0 && feedback[5].Err == 0);
+  CHECK(feedback[5].Pos == 2048);
+  servoSim.alive[5] = true;
+
+  // A bad reply fails its servo and the read moves on
+  servoSim.corruptId = 3;
+  CHECK(st.SyncFeedBack(ids, SERVOS, feedback) == SERVOS - 1);
+  CHECK(feedback[2].Err == 2 && feedback[1].Err == 0 && feedback[3].Err == 0);
+  CHECK(feedback[3].Pos == 2048);
+
+  // A bad last reply ends the read without waiting for another reply
+  servoSim.corruptId = SERVOS;
+  unsigned long start = micros();
+  CHECK(st.SyncFeedBack(ids, SERVOS, feedback, timeouts) == SERVOS - 1);
+  unsigned long elapsed = micros() - start;
+  CHECK(feedback[SERVOS - 1].Err == 2);
+  CHECK(elapsed < timeouts[SERVOS - 1] / 2);
+  servoSim.corruptId = -1;
+
+  // Per-servo timeouts give up a silent servo early and are not kept
+  servoSim.alive[3] = false;
+  servoSim.alive[SERVOS] = false;
+  for (int i = 0; i < SERVOS; i++)
+    timeouts[i] = 200;
+  start = micros();
+  CHECK(st.SyncFeedBack(ids, SERVOS, feedback, timeouts) == SERVOS - 2);
+  elapsed = micros() - start;
+  CHECK(feedback[2].Err == 1 && feedback[SERVOS - 1].Err == 1 && feedback[SERVOS - 2].Err == 0);
+  CHECK(elapsed < 20000 / 2);
+  CHECK(st.IOTimeOutUs == 20000);
+
+  // Without a microsecond timeout the millisecond IOTimeOut applies, the
+  // silent last servo is waited for 2 ms
+  st.IOTimeOutUs = 0;
+  st.IOTimeOut = 2;
+  start = micros();
+  CHECK(st.SyncFeedBack(ids, SERVOS, feedback) == SERVOS - 2);
+  elapsed = micros() - start;
+  CHECK(elapsed >= 2000 && elapsed < 20000);
+
+  if (failures != 0)
+    return 1;
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,123 @@
+// ======================================================================
+// Token Lookup Benchmark
+// ======================================================================
+// TokenTable lookups against the strcmp chains they replaced, over the
+// real servo names and data types, with one unknown token in four. Both
+// must give the same index for every token. Built with -std=gnu++11, so
+// it also checks that token_hash.h stays C++11 clean.
+//
+//     token_bench [rounds]   default 200000
+
+#include "protocol.h"
+#include "token_hash.h"
+#include <stdio.h>
+#include <chrono>
+
+static constexpr TokenTable<TOTAL_SERVOS, 32> SERVO_NAME_TABLE(SERVO_NAMES);
+static_assert(SERVO_NAME_TABLE.valid(), "no perfect hash for servo names");
+
+static const char *const UNKNOWN_TOKENS[] = {
+    "rightGripperX",
+    "neck",
+    "",
+    "headTil",
+    "batteryLevel",
+};
+
+static int linearFind(const char *const *names, int count, const char *token)
+{
+  for (int i = 0; i < count; i++)
+  {
+    if (strcmp(token, names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+static int servoByHash(const char *token)
+{
+  return SERVO_NAME_TABLE.find(token);
+}
+
+static int servoByStrcmp(const char *token)
+{
+  return linearFind(SERVO_NAMES, TOTAL_SERVOS, token);
+}
+
+static const char *dataTypeNames[32];
+static int dataTypeCount = 0;
+
+static int dataTypeByHash(const char *token)
+{
+  return parseDataType(token);
+}
+
+static int dataTypeByStrcmp(const char *token)
+{
+  return linearFind(dataTypeNames, dataTypeCount, token);
+}
+
+// Known names with an unknown token after every third
+static int buildTokens(const char *const *names, int count, const char **tokens)
+{
+  int n = 0;
+  for (int i = 0; i < count; i++)
+  {
+    tokens[n++] = names[i];
+    if (i % 3 == 2)
+      tokens[n++] = UNKNOWN_TOKENS[i % 5];
+  }
+  return n;
+}
+
+static double nsPerLookup(int (*find)(const char *), const char **tokens, int count, long rounds, long &sum)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (long r = 0; r < rounds; r++)
+  {
+    for (int i = 0; i < count; i++)
+      sum += find(tokens[i]);
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (rounds * count);
+}
+
+static bool bench(const char *name, const char *const *names, int count,
+                  int (*byHash)(const char *), int (*byStrcmp)(const char *), long rounds)
+{
+  const char *tokens[64];
+  int n = buildTokens(names, count, tokens);
+
+  for (int i = 0; i < n; i++)
+  {
+    if (byHash(tokens[i]) != byStrcmp(tokens[i]))
+    {
+      printf("FAIL: %s lookups disagree on \"%s\"\n", name, tokens[i]);
+      return false;
+    }
+  }
+
+  long sum = 0;
+  double hash = nsPerLookup(byHash, tokens, n, rounds, sum);
+  double linear = nsPerLookup(byStrcmp, tokens, n, rounds, sum);
+  printf("%-10s %6d %10.1f %10.1f   (%ld)\n", name, count, hash, linear, sum);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  long rounds = argc > 1 ? strtol(argv[1], nullptr, 10) : 200000;
+
+  while (dataTypeCount < 32 && strcmp(dataTypeName((DataType)dataTypeCount), "unknown") != 0)
+  {
+    dataTypeNames[dataTypeCount] = dataTypeName((DataType)dataTypeCount);
+    dataTypeCount++;
+  }
+
+  printf("%-10s %6s %10s %10s\n", "tokens", "names", "hash ns", "strcmp ns");
+  bool ok = bench("servo", SERVO_NAMES, TOTAL_SERVOS, servoByHash, servoByStrcmp, rounds) &&
+            bench("dataType", dataTypeNames, dataTypeCount, dataTypeByHash, dataTypeByStrcmp, rounds);
+  if (!ok)
+    return 1;
+  printf("ok\n");
+  return 0;
+}